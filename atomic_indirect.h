@@ -0,0 +1,360 @@
+#pragma once
+
+#include <cow_indirect.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// `atomic_indirect<T>` publishes a `cow_indirect<T>` to threads that read it
+// while others replace it, as a configuration reloaded at run time is.
+// `load()` returns a `read_handle` to the object published at the time, which
+// stays valid until the handle is destroyed however often the object is
+// replaced. Loads never lock and write no cache line that another thread
+// writes: rather than counting references to the block, each reader announces
+// the object it reads in a hazard pointer of its own, and a replaced object is
+// destroyed once no hazard pointer refers to it.
+//
+// Readers share the object, so a `read_handle` gives const access only. It
+// must not outlive the `atomic_indirect` it was loaded from; `share()` it for
+// a `cow_indirect` that may.
+template <typename T>
+class atomic_indirect;
+
+namespace detail
+{
+
+    constexpr std::size_t hazard_line_size = 64;
+    constexpr std::size_t hazard_cache_size = 8;
+
+    // A hazard pointer on a cache line of its own, owned by one thread at a
+    // time. Slots are never freed, so a scan can always walk the list.
+    struct alignas(hazard_line_size) hazard_slot
+    {
+        std::atomic<void const*> protects{nullptr};
+        std::atomic<bool> owned{true};
+        hazard_slot* next = nullptr;
+
+        static std::atomic<hazard_slot*>& head() noexcept
+        {
+            static std::atomic<hazard_slot*> list{nullptr};
+            return list;
+        }
+
+        static hazard_slot* create()
+        {
+#ifdef __cpp_aligned_new
+            auto s = new hazard_slot;
+#else
+            auto p = reinterpret_cast<std::uintptr_t>(::operator new(sizeof(hazard_slot) + hazard_line_size));
+            auto s = ::new (reinterpret_cast<void*>((p + hazard_line_size - 1) & ~(hazard_line_size - 1))) hazard_slot;
+#endif
+            auto& list = head();
+            s->next = list.load(std::memory_order_relaxed);
+            while (!list.compare_exchange_weak(s->next, s, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+            return s;
+        }
+
+        // Takes a slot that no thread owns, or adds one.
+        static hazard_slot* acquire()
+        {
+            for (auto s = head().load(std::memory_order_acquire); s; s = s->next)
+            {
+                if (!s->owned.load(std::memory_order_relaxed) && !s->owned.exchange(true, std::memory_order_acquire))
+                {
+                    return s;
+                }
+            }
+            return create();
+        }
+    };
+
+    inline bool hazard_protected(void const* p) noexcept
+    {
+        for (auto s = hazard_slot::head().load(std::memory_order_acquire); s; s = s->next)
+        {
+            if (s->protects.load(std::memory_order_seq_cst) == p)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The slots a thread has released, kept for its next loads so that a load
+    // touches no shared line to find a slot. They are given up when it exits.
+    struct hazard_cache
+    {
+        hazard_slot* slots[hazard_cache_size];
+        std::size_t size;
+        bool exited;
+
+        static hazard_cache& local() noexcept
+        {
+            thread_local hazard_cache cache{};
+            return cache;
+        }
+    };
+
+    struct hazard_releaser
+    {
+        ~hazard_releaser()
+        {
+            auto& cache = hazard_cache::local();
+            cache.exited = true;
+            while (cache.size != 0)
+            {
+                cache.slots[--cache.size]->owned.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    inline hazard_slot* acquire_hazard()
+    {
+        auto& cache = hazard_cache::local();
+        if (cache.size != 0)
+        {
+            return cache.slots[--cache.size];
+        }
+        return hazard_slot::acquire();
+    }
+
+    // Clearing the slot releases the reader's accesses to the object to the
+    // thread that destroys it.
+    inline void release_hazard(hazard_slot* s) noexcept
+    {
+        s->protects.store(nullptr, std::memory_order_release);
+        auto& cache = hazard_cache::local();
+        if (!cache.exited && cache.size != hazard_cache_size)
+        {
+            if (cache.size == 0)
+            {
+                thread_local hazard_releaser release;
+                (void)release;
+            }
+            cache.slots[cache.size++] = s;
+        }
+        else
+        {
+            s->owned.store(false, std::memory_order_release);
+        }
+    }
+
+} // namespace detail
+
+template <typename T>
+class atomic_indirect
+{
+private:
+    // Each published value is a node of its own, so that a reader's hazard
+    // pointer names both the object and the block it shares.
+    struct node
+    {
+        cow_indirect<T> value;
+        node* next_retired;
+    };
+
+    std::atomic<node*> current;
+    std::atomic<node*> retired{nullptr};
+
+    static node* make_node(cow_indirect<T>&& value)
+    {
+        return new node{std::move(value), nullptr};
+    }
+
+    void push_retired(node* n) noexcept
+    {
+        n->next_retired = retired.load(std::memory_order_relaxed);
+        while (!retired.compare_exchange_weak(n->next_retired, n, std::memory_order_release,
+                                              std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void retire(node* n) noexcept
+    {
+        push_retired(n);
+        reclaim();
+    }
+
+public:
+    // Read access to the object published when it was loaded.
+    class read_handle
+    {
+        friend class atomic_indirect;
+
+    private:
+        detail::hazard_slot* slot = nullptr;
+        node const* n = nullptr;
+        T const* ptr = nullptr;
+
+        read_handle() = default;
+
+    public:
+        read_handle(read_handle&& other) noexcept :
+            slot(other.slot),
+            n(other.n),
+            ptr(other.ptr)
+        {
+            other.slot = nullptr;
+            other.n = nullptr;
+            other.ptr = nullptr;
+        }
+
+        read_handle& operator=(read_handle&& other) noexcept
+        {
+            if (this != &other)
+            {
+                std::swap(slot, other.slot);
+                std::swap(n, other.n);
+                std::swap(ptr, other.ptr);
+                other.reset();
+            }
+            return *this;
+        }
+
+        ~read_handle()
+        {
+            reset();
+        }
+
+        T const* operator->() const noexcept
+        {
+            return ptr;
+        }
+
+        T const& operator*() const noexcept
+        {
+            return *ptr;
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return ptr != nullptr;
+        }
+
+        // A `cow_indirect` sharing the object, which may outlive the handle.
+        cow_indirect<T> share() const noexcept
+        {
+            return n->value;
+        }
+
+    private:
+        void reset() noexcept
+        {
+            if (slot)
+            {
+                detail::release_hazard(slot);
+            }
+            slot = nullptr;
+            n = nullptr;
+            ptr = nullptr;
+        }
+    };
+
+    template <typename T_ = T, std::enable_if_t<std::is_default_constructible<T_>::value, int> = 0>
+    atomic_indirect() :
+        current(make_node(cow_indirect<T>()))
+    {
+    }
+
+    explicit atomic_indirect(cow_indirect<T> value) :
+        current(make_node(std::move(value)))
+    {
+    }
+
+    atomic_indirect(atomic_indirect const&) = delete;
+    atomic_indirect& operator=(atomic_indirect const&) = delete;
+
+    ~atomic_indirect()
+    {
+        delete current.load(std::memory_order_relaxed);
+        auto n = retired.load(std::memory_order_relaxed);
+        while (n)
+        {
+            auto next = n->next_retired;
+            delete n;
+            n = next;
+        }
+    }
+
+    read_handle load() const
+    {
+        read_handle h;
+        h.slot = detail::acquire_hazard();
+        auto n = current.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            h.slot->protects.store(n, std::memory_order_seq_cst);
+            auto now = current.load(std::memory_order_seq_cst);
+            if (now == n)
+            {
+                break;
+            }
+            n = now;
+        }
+        h.n = n;
+        // The non-const access of `cow_indirect` would detach a shared block.
+        h.ptr = static_cast<cow_indirect<T> const&>(n->value).operator->();
+        return h;
+    }
+
+    // Publishes `value`. The object it replaces is destroyed now if no reader
+    // holds it, and otherwise by a later replacement or `reclaim()`.
+    void store(cow_indirect<T> value)
+    {
+        retire(current.exchange(make_node(std::move(value)), std::memory_order_seq_cst));
+    }
+
+    cow_indirect<T> exchange(cow_indirect<T> value)
+    {
+        auto old = current.exchange(make_node(std::move(value)), std::memory_order_seq_cst);
+        // Readers may still share the old node's `cow_indirect`, so it is
+        // copied rather than moved out.
+        cow_indirect<T> r(old->value);
+        retire(old);
+        return r;
+    }
+
+    // Publishes `desired` if the object published is still the one `expected`
+    // was loaded with; otherwise reloads `expected` and returns false. The
+    // handle keeps its object alive, so the comparison cannot be fooled by a
+    // node that was reused.
+    bool compare_exchange(read_handle& expected, cow_indirect<T> desired)
+    {
+        auto n = make_node(std::move(desired));
+        auto e = const_cast<node*>(expected.n);
+        if (current.compare_exchange_strong(e, n, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            retire(e);
+            return true;
+        }
+        delete n;
+        expected = load();
+        return false;
+    }
+
+    // Destroys the replaced objects that no reader holds any more.
+    void reclaim() noexcept
+    {
+        auto n = retired.exchange(nullptr, std::memory_order_acquire);
+        while (n)
+        {
+            auto next = n->next_retired;
+            if (detail::hazard_protected(n))
+            {
+                push_retired(n);
+            }
+            else
+            {
+                delete n;
+            }
+            n = next;
+        }
+    }
+};
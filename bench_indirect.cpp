@@ -0,0 +1,1066 @@
+#include <atomic_indirect.h>
+#include <benchmark/benchmark.h>
+#include <closed_indirect.h>
+#include <compact_indirect.h>
+#include <cow_indirect.h>
+#include <hashed_indirect.h>
+#include <indirect.h>
+#include <indirect_array.h>
+#include <indirect_parallel.h>
+#include <indirect_prefetch.h>
+#include <indirect_serialization.h>
+#include <indirect_view.h>
+#include <indirect_vector.h>
+#include <pooled_indirect.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <type_traits>
+#include <unordered_set>
+#include <variant>
+#include <vector>
+
+namespace
+{
+
+    class base
+    {
+    public:
+        virtual ~base() = default;
+        virtual int get_value() const = 0;
+        virtual std::unique_ptr<base> clone() const = 0;
+    };
+
+    class derived : public base
+    {
+    private:
+        int value;
+
+    public:
+        derived(int v) : value(v) {}
+        int get_value() const override { return value; }
+        std::unique_ptr<base> clone() const override { return std::make_unique<derived>(*this); }
+    };
+
+    // Keys whose hash reads every point, as a polymorphic hash of a large
+    // object does.
+    class shape
+    {
+    public:
+        virtual ~shape() = default;
+        virtual std::size_t digest() const = 0;
+        virtual bool same(shape const& other) const = 0;
+
+        friend bool operator==(shape const& a, shape const& b) { return a.same(b); }
+    };
+
+    class polygon final : public shape
+    {
+    private:
+        std::array<double, 64> points;
+
+    public:
+        explicit polygon(int seed)
+        {
+            for (std::size_t i = 0; i < points.size(); ++i)
+            {
+                points[i] = seed + 0.5 * static_cast<double>(i);
+            }
+        }
+
+        std::size_t digest() const override
+        {
+            std::size_t h = 14695981039346656037ull;
+            for (auto p : points)
+            {
+                h = (h ^ std::hash<double>()(p)) * 1099511628211ull;
+            }
+            return h;
+        }
+
+        bool same(shape const& other) const override
+        {
+            auto p = dynamic_cast<polygon const*>(&other);
+            return p && p->points == points;
+        }
+    };
+
+} // namespace
+
+namespace std
+{
+
+    template <>
+    struct hash<shape>
+    {
+        std::size_t operator()(shape const& s) const
+        {
+            return s.digest();
+        }
+    };
+
+} // namespace std
+
+template <>
+struct indirect_serializer<derived>
+{
+    static void save(indirect_writer& w, derived const& d)
+    {
+        w.write(d.get_value());
+    }
+
+    static derived load(indirect_reader& r)
+    {
+        return derived(r.read<int>());
+    }
+};
+
+namespace
+{
+
+    class derived_other : public base
+    {
+    private:
+        int value;
+        int padding[3] = {};
+
+    public:
+        derived_other(int v) : value(v) {}
+        int get_value() const override { return value; }
+        std::unique_ptr<base> clone() const override { return std::make_unique<derived_other>(*this); }
+    };
+
+    class derived_final final : public base
+    {
+    private:
+        int value;
+
+    public:
+        derived_final(int v) : value(v) {}
+        int get_value() const override { return value; }
+        std::unique_ptr<base> clone() const override { return std::make_unique<derived_final>(*this); }
+    };
+
+    class derived_other_final final : public base
+    {
+    private:
+        int value;
+        int padding[3] = {};
+
+    public:
+        derived_other_final(int v) : value(v) {}
+        int get_value() const override { return value; }
+        std::unique_ptr<base> clone() const override { return std::make_unique<derived_other_final>(*this); }
+    };
+
+    // A message struct whose block is copied by its bytes, and the same
+    // struct with a copy constructor that keeps it from being trivial.
+    struct pod_message
+    {
+        int id;
+        double payload[5];
+
+        pod_message(int i) : id(i), payload() {}
+    };
+
+    struct copied_message : pod_message
+    {
+        using pod_message::pod_message;
+        copied_message(copied_message const& other) noexcept : pod_message(other) {}
+    };
+
+    // The control block design `indirect` used before its hand-rolled
+    // vtables: one virtual call and one `make_unique` per copy.
+    namespace virtual_design
+    {
+
+        class control_block
+        {
+        public:
+            virtual ~control_block() = default;
+            virtual std::unique_ptr<control_block> copy() const = 0;
+            virtual void* ptr() = 0;
+        };
+
+        template <typename T>
+        class direct_control_block final : public control_block
+        {
+        private:
+            T t;
+
+        public:
+            template <typename... Ts>
+            explicit direct_control_block(Ts&&... ts) : t(std::forward<Ts>(ts)...) {}
+
+            std::unique_ptr<control_block> copy() const override { return std::make_unique<direct_control_block>(t); }
+
+            void* ptr() override { return &t; }
+        };
+
+        template <typename T>
+        class indirect
+        {
+        private:
+            T* ptr;
+            std::unique_ptr<control_block> cb;
+
+        public:
+            template <typename U, std::enable_if_t<std::is_base_of<T, std::decay_t<U>>::value, int> = 0>
+            indirect(U&& u) : cb(std::make_unique<direct_control_block<std::decay_t<U>>>(std::forward<U>(u)))
+            {
+                ptr = static_cast<std::decay_t<U>*>(cb->ptr());
+            }
+
+            indirect(indirect const& other) : cb(other.cb->copy())
+            {
+                ptr = static_cast<T*>(cb->ptr());
+            }
+
+            indirect(indirect&&) noexcept = default;
+
+            indirect& operator=(indirect const& other)
+            {
+                cb = other.cb->copy();
+                ptr = static_cast<T*>(cb->ptr());
+                return *this;
+            }
+
+            indirect& operator=(indirect&&) noexcept = default;
+
+            T const* operator->() const noexcept { return ptr; }
+        };
+
+    } // namespace virtual_design
+
+    // `std::unique_ptr` made copyable through a virtual `clone`.
+    class cloning_ptr
+    {
+    private:
+        std::unique_ptr<base> p;
+
+    public:
+        template <typename U, std::enable_if_t<std::is_base_of<base, std::decay_t<U>>::value, int> = 0>
+        cloning_ptr(U&& u) : p(std::make_unique<std::decay_t<U>>(std::forward<U>(u)))
+        {
+        }
+
+        cloning_ptr(cloning_ptr const& other) : p(other.p->clone()) {}
+        cloning_ptr(cloning_ptr&&) noexcept = default;
+
+        cloning_ptr& operator=(cloning_ptr const& other)
+        {
+            p = other.p->clone();
+            return *this;
+        }
+
+        cloning_ptr& operator=(cloning_ptr&&) noexcept = default;
+
+        base const* operator->() const noexcept { return p.get(); }
+
+        friend void swap(cloning_ptr& a, cloning_ptr& b) noexcept { std::swap(a.p, b.p); }
+    };
+
+    using variant_type = std::variant<derived, derived_other>;
+
+    template <typename H>
+    int value_of(H const& h)
+    {
+        return h->get_value();
+    }
+
+    int value_of(variant_type const& v)
+    {
+        return std::visit([](auto const& x) { return x.get_value(); }, v);
+    }
+
+    // Alternates between the two derived types so that containers hold more
+    // than one dynamic type.
+    template <typename H>
+    H make_handle(int i)
+    {
+        if (i % 2)
+        {
+            return H{derived_other{i}};
+        }
+        return H{derived{i}};
+    }
+
+    using heap_indirect = indirect<base>;
+    using inline_indirect = indirect<base, inline_storage<32>>;
+    using pooled = pooled_indirect<base>;
+    using compact = compact_indirect<base>;
+    using cow = cow_indirect<base>;
+    using virtual_indirect = virtual_design::indirect<base>;
+    using closed = closed_indirect<base, derived, derived_other>;
+
+    template <typename H>
+    void construct(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            H h{derived{42}};
+            benchmark::DoNotOptimize(h);
+        }
+    }
+
+    template <typename H, typename D = derived>
+    void copy_construct(benchmark::State& state)
+    {
+        H h{D{42}};
+        for (auto _ : state)
+        {
+            H copy{h};
+            benchmark::DoNotOptimize(copy);
+        }
+    }
+
+    template <typename H>
+    void copy_assign(benchmark::State& state)
+    {
+        H h{derived{42}};
+        H copy{derived{0}};
+        for (auto _ : state)
+        {
+            copy = h;
+            benchmark::DoNotOptimize(copy);
+        }
+    }
+
+    template <typename H>
+    void move_construct(benchmark::State& state)
+    {
+        H h{derived{42}};
+        for (auto _ : state)
+        {
+            H moved{std::move(h)};
+            h = std::move(moved);
+            benchmark::DoNotOptimize(h);
+        }
+    }
+
+    template <typename H>
+    void dereference(benchmark::State& state)
+    {
+        H h{derived{42}};
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(value_of(h));
+        }
+    }
+
+    template <typename H>
+    void replace_assign(benchmark::State& state)
+    {
+        H h{derived{0}};
+        int i = 0;
+        for (auto _ : state)
+        {
+            h = derived{++i};
+            benchmark::DoNotOptimize(h);
+        }
+    }
+
+    template <typename H>
+    void replace_emplace(benchmark::State& state)
+    {
+        H h{derived{0}};
+        int i = 0;
+        for (auto _ : state)
+        {
+            h.template emplace<derived>(++i);
+            benchmark::DoNotOptimize(h);
+        }
+    }
+
+    template <typename H>
+    void swap_handles(benchmark::State& state)
+    {
+        H a{derived{1}};
+        H b{derived_other{2}};
+        for (auto _ : state)
+        {
+            using std::swap;
+            swap(a, b);
+            benchmark::DoNotOptimize(a);
+            benchmark::DoNotOptimize(b);
+        }
+    }
+
+    template <typename H>
+    void static_cast_copy(benchmark::State& state)
+    {
+        H h{derived{42}};
+        for (auto _ : state)
+        {
+            auto d = static_indirect_cast<derived>(h);
+            benchmark::DoNotOptimize(d);
+        }
+    }
+
+    template <typename H>
+    void dynamic_cast_copy(benchmark::State& state)
+    {
+        H h{derived{42}};
+        for (auto _ : state)
+        {
+            auto d = dynamic_indirect_cast<derived>(h);
+            benchmark::DoNotOptimize(d);
+        }
+    }
+
+    template <typename H>
+    void dynamic_cast_move(benchmark::State& state)
+    {
+        H h{derived{42}};
+        for (auto _ : state)
+        {
+            auto d = dynamic_indirect_cast<derived>(std::move(h));
+            h = std::move(d);
+            benchmark::DoNotOptimize(h);
+        }
+    }
+
+    template <typename H>
+    void dynamic_cast_view(benchmark::State& state)
+    {
+        H h{derived{42}};
+        for (auto _ : state)
+        {
+            auto d = dynamic_indirect_cast_view<derived>(h);
+            benchmark::DoNotOptimize(d);
+        }
+    }
+
+    template <typename H>
+    void exact_cast_view(benchmark::State& state)
+    {
+        H h{derived{42}};
+        for (auto _ : state)
+        {
+            auto d = exact_indirect_cast_view<derived>(h);
+            benchmark::DoNotOptimize(d);
+        }
+    }
+
+    // Probes for the type of the object as dispatch code does, the match
+    // being the last of three candidates.
+    template <typename H>
+    void dynamic_cast_probe(benchmark::State& state)
+    {
+        H h{derived{42}};
+        for (auto _ : state)
+        {
+            int r = dynamic_indirect_cast_view<derived_final>(h) ? 1
+                    : dynamic_indirect_cast_view<derived_other>(h) ? 2
+                    : dynamic_indirect_cast_view<derived>(h) ? 3
+                                                                 : 0;
+            benchmark::DoNotOptimize(r);
+        }
+    }
+
+    template <typename H>
+    void exact_cast_probe(benchmark::State& state)
+    {
+        H h{derived{42}};
+        for (auto _ : state)
+        {
+            int r = h.template holds_type<derived_final>()   ? 1
+                    : h.template holds_type<derived_other>() ? 2
+                    : h.template holds_type<derived>()       ? 3
+                                                             : 0;
+            benchmark::DoNotOptimize(r);
+        }
+    }
+
+    template <typename H>
+    void vector_push_back(benchmark::State& state)
+    {
+        auto n = static_cast<int>(state.range(0));
+        for (auto _ : state)
+        {
+            std::vector<H> v;
+            for (int i = 0; i < n; ++i)
+            {
+                v.push_back(make_handle<H>(i));
+            }
+            benchmark::DoNotOptimize(v.data());
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+
+    template <typename H>
+    void vector_sort(benchmark::State& state)
+    {
+        auto n = static_cast<int>(state.range(0));
+        std::vector<H> source;
+        for (int i = 0; i < n; ++i)
+        {
+            source.push_back(make_handle<H>((i * 7919) % n));
+        }
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            auto v = source;
+            state.ResumeTiming();
+            std::sort(v.begin(), v.end(), [](H const& a, H const& b) { return value_of(a) < value_of(b); });
+            benchmark::DoNotOptimize(v.data());
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+
+    template <typename H>
+    void vector_copy(benchmark::State& state)
+    {
+        auto n = static_cast<int>(state.range(0));
+        std::vector<H> source;
+        for (int i = 0; i < n; ++i)
+        {
+            source.push_back(make_handle<H>(i));
+        }
+        for (auto _ : state)
+        {
+            auto v = source;
+            benchmark::DoNotOptimize(v.data());
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+
+    // Copies a large vector on `state.range(1)` threads.
+    template <typename H>
+    void vector_parallel_copy(benchmark::State& state)
+    {
+        auto n = static_cast<int>(state.range(0));
+        auto threads = static_cast<std::size_t>(state.range(1));
+        std::vector<H> source;
+        for (int i = 0; i < n; ++i)
+        {
+            source.push_back(make_handle<H>(i));
+        }
+        for (auto _ : state)
+        {
+            auto v = parallel_copy(source, threads);
+            benchmark::DoNotOptimize(v.data());
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+
+    std::vector<indirect<derived>> make_one_by_one(std::size_t n)
+    {
+        std::vector<indirect<derived>> v;
+        v.reserve(n);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            v.push_back(make_indirect<derived>(42));
+        }
+        return v;
+    }
+
+    std::vector<indirect<derived>> make_in_slab(std::size_t n)
+    {
+        return make_indirect_array<derived>(n, 42);
+    }
+
+    template <std::vector<indirect<derived>> (*Make)(std::size_t)>
+    void bulk_create(benchmark::State& state)
+    {
+        auto n = static_cast<std::size_t>(state.range(0));
+        for (auto _ : state)
+        {
+            auto v = Make(n);
+            benchmark::DoNotOptimize(v.data());
+        }
+        state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n));
+    }
+
+    template <std::vector<indirect<derived>> (*Make)(std::size_t)>
+    void bulk_read(benchmark::State& state)
+    {
+        auto n = static_cast<std::size_t>(state.range(0));
+        auto v = Make(n);
+        for (auto _ : state)
+        {
+            int sum = 0;
+            for (auto const& i : v)
+            {
+                sum += i->get_value();
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n));
+    }
+
+    // Sums elements of alternating dynamic types: through a vector of
+    // `indirect`s in insertion order, through an `indirect_vector` segment by
+    // segment, and through an `indirect_vector` with both (final) types named
+    // so their calls are not virtual.
+    void interleaved_read(benchmark::State& state)
+    {
+        auto n = static_cast<int>(state.range(0));
+        std::vector<heap_indirect> v;
+        for (int i = 0; i < n; ++i)
+        {
+            v.push_back(i % 2 ? heap_indirect{derived_other_final{i}} : heap_indirect{derived_final{i}});
+        }
+        for (auto _ : state)
+        {
+            int sum = 0;
+            for (auto const& i : v)
+            {
+                sum += i->get_value();
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+
+    template <typename... Us>
+    void segmented_read(benchmark::State& state)
+    {
+        auto n = static_cast<int>(state.range(0));
+        indirect_vector<base> v;
+        for (int i = 0; i < n; ++i)
+        {
+            if (i % 2)
+            {
+                v.emplace<derived_other_final>(i);
+            }
+            else
+            {
+                v.emplace<derived_final>(i);
+            }
+        }
+        auto const& c = v;
+        for (auto _ : state)
+        {
+            int sum = 0;
+            c.for_each<Us...>([&](auto const& x) { sum += x.get_value(); });
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+
+    // Relocates an array of handles back and forth between two buffers, as
+    // a growing container would.
+    template <typename H>
+    void relocate_range(benchmark::State& state)
+    {
+        auto n = static_cast<std::size_t>(state.range(0));
+        std::unique_ptr<H[], void (*)(H*)> buffers(static_cast<H*>(::operator new(2 * n * sizeof(H))),
+                                                  [](H* p) { ::operator delete(p); });
+        auto a = buffers.get();
+        auto b = a + n;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            ::new (static_cast<void*>(a + i)) H(make_handle<H>(static_cast<int>(i)));
+        }
+        for (auto _ : state)
+        {
+            uninitialized_relocate(a, a + n, b);
+            std::swap(a, b);
+            benchmark::DoNotOptimize(a);
+        }
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            a[i].~H();
+        }
+        state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n));
+    }
+
+    // Each thread builds a batch of handles and swaps it for the batch last
+    // left in a shared slot by another thread, which it then destroys, so most
+    // blocks are freed by a thread other than the one that allocated them.
+    template <typename H>
+    void cross_thread_destroy(benchmark::State& state)
+    {
+        constexpr int batch = 64;
+        static std::array<std::atomic<std::vector<H>*>, 64> slots;
+
+        int i = state.thread_index();
+        for (auto _ : state)
+        {
+            auto mine = new std::vector<H>;
+            mine->reserve(batch);
+            for (int j = 0; j < batch; ++j)
+            {
+                mine->push_back(make_handle<H>(j));
+            }
+            i = (i + 1) % state.threads();
+            delete slots[i].exchange(mine, std::memory_order_acq_rel);
+        }
+        state.SetItemsProcessed(state.iterations() * batch);
+
+        if (state.thread_index() == 0)
+        {
+            for (auto& slot : slots)
+            {
+                delete slot.exchange(nullptr);
+            }
+        }
+    }
+
+    // Reader threads take copies of one immutable snapshot and read them.
+    template <typename H>
+    void snapshot_read(benchmark::State& state)
+    {
+        static H const snapshot = make_handle<H>(42);
+        for (auto _ : state)
+        {
+            H copy = snapshot;
+            benchmark::DoNotOptimize(value_of(copy));
+        }
+    }
+
+    // A policy that readers use while it is replaced, guarded by a mutex.
+    class locked_policy
+    {
+    private:
+        mutable std::mutex mutex;
+        heap_indirect policy{derived{0}};
+
+    public:
+        int read() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return policy->get_value();
+        }
+
+        void replace(int i)
+        {
+            heap_indirect next = make_handle<heap_indirect>(i);
+            std::lock_guard<std::mutex> lock(mutex);
+            policy.swap(next);
+        }
+    };
+
+    class published_policy
+    {
+    private:
+        atomic_indirect<base> policy{cow{derived{0}}};
+
+    public:
+        int read() const
+        {
+            return policy.load()->get_value();
+        }
+
+        void replace(int i)
+        {
+            policy.store(make_handle<cow>(i));
+        }
+    };
+
+    // Reader threads read a shared policy, which the first thread replaces
+    // every 1024 reads.
+    template <typename P>
+    void policy_read(benchmark::State& state)
+    {
+        static P policy;
+        int i = 0;
+        for (auto _ : state)
+        {
+            if (state.thread_index() == 0 && ++i % 1024 == 0)
+            {
+                policy.replace(i);
+            }
+            benchmark::DoNotOptimize(policy.read());
+        }
+    }
+
+    std::vector<char> saved_vector(indirect_registry<base> const& registry, std::size_t n)
+    {
+        std::vector<heap_indirect> v;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            v.emplace_back(derived{static_cast<int>(i)});
+        }
+        std::vector<char> bytes;
+        indirect_writer w(bytes);
+        registry.save(w, v);
+        return bytes;
+    }
+
+    indirect_registry<base> bench_registry()
+    {
+        indirect_registry<base> registry;
+        registry.add<derived>(1);
+        return registry;
+    }
+
+    // Elements whose objects were allocated in random order, so that reaching
+    // each object from the last is a cache miss once they outgrow the cache.
+    std::vector<heap_indirect> scattered(std::size_t n)
+    {
+        std::vector<heap_indirect> v;
+        v.reserve(n);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            v.emplace_back(derived{static_cast<int>(i)});
+        }
+        std::shuffle(v.begin(), v.end(), std::mt19937(42));
+        return v;
+    }
+
+    void scattered_loop(benchmark::State& state)
+    {
+        auto v = scattered(static_cast<std::size_t>(state.range(0)));
+        for (auto _ : state)
+        {
+            int sum = 0;
+            for (auto const& i : v)
+            {
+                sum += i->get_value();
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    // The second argument is the prefetch distance.
+    void scattered_for_each(benchmark::State& state)
+    {
+        auto v = scattered(static_cast<std::size_t>(state.range(0)));
+        auto distance = static_cast<std::size_t>(state.range(1));
+        for (auto _ : state)
+        {
+            int sum = 0;
+            for_each_indirect(v, [&](heap_indirect const& i) { sum += i->get_value(); }, distance);
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    // Reads a vector of one type: as a run loaded into one slab, and element
+    // by element as a hand-written tag switch would.
+    void load_vector(benchmark::State& state)
+    {
+        auto registry = bench_registry();
+        auto bytes = saved_vector(registry, static_cast<std::size_t>(state.range(0)));
+        for (auto _ : state)
+        {
+            indirect_reader r(bytes.data(), bytes.size());
+            auto v = registry.load_vector(r);
+            benchmark::DoNotOptimize(v.data());
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    // Opens an arena of the same objects and views every element, which
+    // constructs none of them.
+    void view_arena(benchmark::State& state)
+    {
+        auto registry = bench_registry();
+        std::vector<heap_indirect> v;
+        for (int i = 0; i < state.range(0); ++i)
+        {
+            v.emplace_back(derived{i});
+        }
+        std::vector<char> bytes;
+        indirect_writer w(bytes);
+        registry.save_arena(w, v);
+        for (auto _ : state)
+        {
+            indirect_arena_view<base> arena(registry, bytes.data(), bytes.size());
+            std::size_t n = 0;
+            for (std::size_t i = 0; i < arena.size(); ++i)
+            {
+                n += arena[i].holds_type<derived>();
+            }
+            benchmark::DoNotOptimize(n);
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    void load_each(benchmark::State& state)
+    {
+        auto registry = bench_registry();
+        auto bytes = saved_vector(registry, static_cast<std::size_t>(state.range(0)));
+        for (auto _ : state)
+        {
+            indirect_reader r(bytes.data(), bytes.size());
+            auto n = r.read<std::uint64_t>();
+            r.read<std::uint32_t>();
+            r.read<std::uint64_t>();
+            std::vector<heap_indirect> v;
+            v.reserve(n);
+            for (std::uint64_t i = 0; i < n; ++i)
+            {
+                v.emplace_back(indirect_serializer<derived>::load(r));
+            }
+            benchmark::DoNotOptimize(v.data());
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    template <typename K>
+    std::vector<K> shape_keys(std::size_t n)
+    {
+        std::vector<K> keys;
+        keys.reserve(n);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            keys.emplace_back(polygon{static_cast<int>(i)});
+        }
+        return keys;
+    }
+
+    // Each rehash hashes every element again unless the hash is kept.
+    template <typename K>
+    void hash_set_rehash(benchmark::State& state)
+    {
+        auto n = static_cast<std::size_t>(state.range(0));
+        auto keys = shape_keys<K>(n);
+        std::unordered_set<K> set(keys.begin(), keys.end());
+        auto buckets = set.bucket_count();
+        bool grow = true;
+        for (auto _ : state)
+        {
+            set.rehash(grow ? buckets * 4 : buckets);
+            grow = !grow;
+            benchmark::DoNotOptimize(set.bucket_count());
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    template <typename K>
+    void hash_set_find(benchmark::State& state)
+    {
+        auto n = static_cast<std::size_t>(state.range(0));
+        auto keys = shape_keys<K>(n);
+        std::unordered_set<K> set(keys.begin(), keys.end());
+        for (auto _ : state)
+        {
+            std::size_t found = 0;
+            for (auto const& k : keys)
+            {
+                found += set.count(k);
+            }
+            benchmark::DoNotOptimize(found);
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+} // namespace
+
+#define INDIRECT_BENCHMARK_HANDLES(name)        \
+    BENCHMARK_TEMPLATE(name, heap_indirect);    \
+    BENCHMARK_TEMPLATE(name, inline_indirect);  \
+    BENCHMARK_TEMPLATE(name, pooled);           \
+    BENCHMARK_TEMPLATE(name, compact);          \
+    BENCHMARK_TEMPLATE(name, cow);              \
+    BENCHMARK_TEMPLATE(name, closed);           \
+    BENCHMARK_TEMPLATE(name, virtual_indirect); \
+    BENCHMARK_TEMPLATE(name, cloning_ptr);      \
+    BENCHMARK_TEMPLATE(name, variant_type)
+
+INDIRECT_BENCHMARK_HANDLES(construct);
+INDIRECT_BENCHMARK_HANDLES(copy_construct);
+INDIRECT_BENCHMARK_HANDLES(copy_assign);
+INDIRECT_BENCHMARK_HANDLES(move_construct);
+INDIRECT_BENCHMARK_HANDLES(dereference);
+
+BENCHMARK_TEMPLATE(copy_construct, virtual_design::indirect<derived_final>, derived_final);
+BENCHMARK_TEMPLATE(copy_construct, indirect<derived_final>, derived_final);
+BENCHMARK_TEMPLATE(copy_construct, pooled_indirect<derived_final>, derived_final);
+BENCHMARK_TEMPLATE(copy_construct, indirect<derived_final, exact_type>, derived_final);
+BENCHMARK_TEMPLATE(copy_construct, indirect<pod_message>, pod_message);
+BENCHMARK_TEMPLATE(copy_construct, indirect<copied_message>, copied_message);
+BENCHMARK_TEMPLATE(copy_construct, indirect<pod_message, inline_storage<64>>, pod_message);
+BENCHMARK_TEMPLATE(copy_construct, indirect<copied_message, inline_storage<64>>, copied_message);
+
+BENCHMARK_TEMPLATE(replace_assign, heap_indirect);
+BENCHMARK_TEMPLATE(replace_assign, inline_indirect);
+BENCHMARK_TEMPLATE(replace_assign, pooled);
+BENCHMARK_TEMPLATE(replace_emplace, heap_indirect);
+BENCHMARK_TEMPLATE(replace_emplace, inline_indirect);
+BENCHMARK_TEMPLATE(replace_emplace, pooled);
+
+BENCHMARK_TEMPLATE(swap_handles, heap_indirect);
+BENCHMARK_TEMPLATE(swap_handles, inline_indirect);
+BENCHMARK_TEMPLATE(swap_handles, pooled);
+BENCHMARK_TEMPLATE(swap_handles, compact);
+BENCHMARK_TEMPLATE(swap_handles, cloning_ptr);
+BENCHMARK_TEMPLATE(swap_handles, variant_type);
+
+BENCHMARK_TEMPLATE(static_cast_copy, heap_indirect);
+BENCHMARK_TEMPLATE(static_cast_copy, inline_indirect);
+BENCHMARK_TEMPLATE(static_cast_copy, compact);
+BENCHMARK_TEMPLATE(dynamic_cast_copy, heap_indirect);
+BENCHMARK_TEMPLATE(dynamic_cast_copy, inline_indirect);
+BENCHMARK_TEMPLATE(dynamic_cast_copy, compact);
+BENCHMARK_TEMPLATE(dynamic_cast_move, heap_indirect);
+BENCHMARK_TEMPLATE(dynamic_cast_move, inline_indirect);
+BENCHMARK_TEMPLATE(dynamic_cast_move, compact);
+BENCHMARK_TEMPLATE(dynamic_cast_view, heap_indirect);
+BENCHMARK_TEMPLATE(dynamic_cast_view, compact);
+BENCHMARK_TEMPLATE(dynamic_cast_view, cow);
+BENCHMARK_TEMPLATE(exact_cast_view, heap_indirect);
+BENCHMARK_TEMPLATE(exact_cast_view, pooled);
+BENCHMARK_TEMPLATE(dynamic_cast_probe, heap_indirect);
+BENCHMARK_TEMPLATE(exact_cast_probe, heap_indirect);
+
+#define INDIRECT_BENCHMARK_CONTAINER(name)                            \
+    BENCHMARK_TEMPLATE(name, heap_indirect)->Range(1 << 8, 1 << 16);    \
+    BENCHMARK_TEMPLATE(name, inline_indirect)->Range(1 << 8, 1 << 16);  \
+    BENCHMARK_TEMPLATE(name, pooled)->Range(1 << 8, 1 << 16);           \
+    BENCHMARK_TEMPLATE(name, compact)->Range(1 << 8, 1 << 16);          \
+    BENCHMARK_TEMPLATE(name, cow)->Range(1 << 8, 1 << 16);              \
+    BENCHMARK_TEMPLATE(name, virtual_indirect)->Range(1 << 8, 1 << 16); \
+    BENCHMARK_TEMPLATE(name, cloning_ptr)->Range(1 << 8, 1 << 16);      \
+    BENCHMARK_TEMPLATE(name, variant_type)->Range(1 << 8, 1 << 16)
+
+INDIRECT_BENCHMARK_CONTAINER(vector_push_back);
+INDIRECT_BENCHMARK_CONTAINER(vector_sort);
+INDIRECT_BENCHMARK_CONTAINER(vector_copy);
+
+BENCHMARK_TEMPLATE(vector_parallel_copy, heap_indirect)
+    ->ArgsProduct({{1 << 20}, {1, 2, 4, 8, 16}})
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(vector_parallel_copy, pooled)
+    ->ArgsProduct({{1 << 20}, {1, 2, 4, 8, 16}})
+    ->UseRealTime();
+
+BENCHMARK_TEMPLATE(bulk_create, make_one_by_one)->Range(1 << 8, 1 << 16);
+BENCHMARK_TEMPLATE(bulk_create, make_in_slab)->Range(1 << 8, 1 << 16);
+BENCHMARK_TEMPLATE(bulk_read, make_one_by_one)->Range(1 << 8, 1 << 16);
+BENCHMARK_TEMPLATE(bulk_read, make_in_slab)->Range(1 << 8, 1 << 16);
+
+BENCHMARK(scattered_loop)->Arg(1 << 20)->Arg(1 << 23)->Arg(100000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(scattered_for_each)
+    ->ArgsProduct({{1 << 20, 1 << 23, 100000000}, {4, 8, 16, 32, 64}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(load_vector)->Range(1 << 8, 1 << 16);
+BENCHMARK(load_each)->Range(1 << 8, 1 << 16);
+BENCHMARK(view_arena)->Range(1 << 8, 1 << 16);
+
+BENCHMARK_TEMPLATE(hash_set_rehash, indirect<shape>)->Range(1 << 10, 1 << 16);
+BENCHMARK_TEMPLATE(hash_set_rehash, hashed_indirect<shape>)->Range(1 << 10, 1 << 16);
+BENCHMARK_TEMPLATE(hash_set_find, indirect<shape>)->Range(1 << 10, 1 << 16);
+BENCHMARK_TEMPLATE(hash_set_find, hashed_indirect<shape>)->Range(1 << 10, 1 << 16);
+
+BENCHMARK(interleaved_read)->Range(1 << 8, 1 << 16);
+BENCHMARK(segmented_read<>)->Range(1 << 8, 1 << 16);
+BENCHMARK_TEMPLATE(segmented_read, derived_final, derived_other_final)->Range(1 << 8, 1 << 16);
+
+BENCHMARK_TEMPLATE(relocate_range, heap_indirect)->Range(1 << 8, 1 << 16);
+BENCHMARK_TEMPLATE(relocate_range, inline_indirect)->Range(1 << 8, 1 << 16);
+BENCHMARK_TEMPLATE(relocate_range, compact)->Range(1 << 8, 1 << 16);
+BENCHMARK_TEMPLATE(relocate_range, cloning_ptr)->Range(1 << 8, 1 << 16);
+
+BENCHMARK_TEMPLATE(cross_thread_destroy, heap_indirect)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_TEMPLATE(cross_thread_destroy, pooled)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_TEMPLATE(cross_thread_destroy, compact)->ThreadRange(1, 64)->UseRealTime();
+
+BENCHMARK_TEMPLATE(snapshot_read, heap_indirect)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_TEMPLATE(snapshot_read, pooled)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_TEMPLATE(snapshot_read, cow)->ThreadRange(1, 64)->UseRealTime();
+
+BENCHMARK_TEMPLATE(policy_read, locked_policy)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_TEMPLATE(policy_read, published_policy)->ThreadRange(1, 64)->UseRealTime();
+
+BENCHMARK_MAIN();
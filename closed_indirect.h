@@ -0,0 +1,505 @@
+#pragma once
+
+#include <indirect.h>
+
+#include <cstddef>
+#include <initializer_list>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// `closed_indirect<Base, Ds...>` is an alternative to `indirect<Base>` for a
+// closed set of derived types: it holds an object of one of `Ds...` inside
+// itself, with the index of its type, and never allocates. Copies, moves and
+// destruction go through tables of functions indexed by the type rather than
+// through a control block. It converts to an `indirect` holding a copy of its
+// object, and can be made from an `indirect` holding one of `Ds...`, so code
+// can change from one to the other piecemeal.
+template <typename Base, typename... Ds>
+class closed_indirect;
+
+namespace detail
+{
+
+    constexpr std::size_t closed_max(std::initializer_list<std::size_t> l) noexcept
+    {
+        std::size_t m = 0;
+        for (auto x : l)
+        {
+            m = x > m ? x : m;
+        }
+        return m;
+    }
+
+    constexpr bool closed_all(std::initializer_list<bool> l) noexcept
+    {
+        for (auto x : l)
+        {
+            if (!x)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The index of U among Ds, or the number of Ds if U is not one of them.
+    template <typename U, typename... Ds>
+    struct closed_index;
+
+    template <typename U>
+    struct closed_index<U> : std::integral_constant<std::size_t, 0>
+    {
+    };
+
+    template <typename U, typename D, typename... Ds>
+    struct closed_index<U, D, Ds...>
+        : std::integral_constant<std::size_t, std::is_same<U, D>::value ? 0 : 1 + closed_index<U, Ds...>::value>
+    {
+    };
+
+    // Calls `f` with the object at `p` as the i-th of Ds through one table
+    // per `F`.
+    template <typename... Ds>
+    struct closed_dispatch
+    {
+        template <typename R, typename F, typename D>
+        static R call(void* p, F& f)
+        {
+            return f(*static_cast<D*>(p));
+        }
+
+        template <typename R, typename F>
+        static R visit(std::size_t i, void* p, F f)
+        {
+            static constexpr R (*table[])(void*, F&) = {&call<R, F, Ds>...};
+            return table[i](p, f);
+        }
+    };
+
+    template <typename... Ts>
+    struct closed_list
+    {
+    };
+
+    // The `closed_indirect<T, Es...>` whose Es are those of Ds derived from T.
+    template <typename T, typename List, typename... Ds>
+    struct closed_cast_result;
+
+    template <typename T, typename... Es>
+    struct closed_cast_result<T, closed_list<Es...>>
+    {
+        static_assert(sizeof...(Es) != 0, "no type of the closed set is derived from T");
+        using type = closed_indirect<T, Es...>;
+    };
+
+    template <typename T, typename... Es, typename D, typename... Ds>
+    struct closed_cast_result<T, closed_list<Es...>, D, Ds...>
+        : closed_cast_result<T, std::conditional_t<std::is_base_of<T, D>::value, closed_list<Es..., D>, closed_list<Es...>>,
+                             Ds...>
+    {
+    };
+
+    template <typename T, typename... Ds>
+    using closed_cast_t = typename closed_cast_result<T, closed_list<>, Ds...>::type;
+
+} // namespace detail
+
+template <typename Base, typename... Ds>
+class closed_indirect
+{
+    template <typename, typename...>
+    friend class closed_indirect;
+
+    static_assert(sizeof...(Ds) != 0, "the closed set of types cannot be empty");
+    static_assert(sizeof...(Ds) < 255, "the closed set of types is too large");
+    static_assert(detail::closed_all({std::is_base_of<Base, Ds>::value...}), "each type must be derived from Base");
+    static_assert(detail::closed_all({std::is_same<Ds, std::remove_cv_t<Ds>>::value...}),
+                  "the types cannot be cv-qualified");
+
+private:
+    using dispatch = detail::closed_dispatch<Ds...>;
+
+    static constexpr unsigned char npos = sizeof...(Ds);
+
+    template <typename U>
+    using index_of = detail::closed_index<std::remove_cv_t<std::remove_reference_t<U>>, Ds...>;
+
+    template <typename U>
+    using enable_if_member_t = std::enable_if_t<(index_of<U>::value < npos), int>;
+
+    alignas(Ds...) unsigned char buffer[detail::closed_max({sizeof(Ds)...})];
+    Base* ptr = nullptr;
+    unsigned char type = npos;
+
+    void* address() const noexcept
+    {
+        return const_cast<unsigned char*>(buffer);
+    }
+
+    template <typename U, typename... Ts>
+    U& construct(Ts&&... ts)
+    {
+        auto p = ::new (address()) U(std::forward<Ts>(ts)...);
+        ptr = p;
+        type = index_of<U>::value;
+        return *p;
+    }
+
+    void copy_from(closed_indirect const& other)
+    {
+        if (other.ptr)
+        {
+            dispatch::template visit<void>(other.type, other.address(), [this](auto const& d) {
+                construct<std::decay_t<decltype(d)>>(d);
+            });
+        }
+    }
+
+    void move_from(closed_indirect& other) noexcept(detail::closed_all({std::is_nothrow_move_constructible<Ds>::value...}))
+    {
+        if (other.ptr)
+        {
+            dispatch::template visit<void>(other.type, other.address(), [this](auto& d) {
+                construct<std::decay_t<decltype(d)>>(std::move(d));
+            });
+            other.reset();
+        }
+    }
+
+    void reset() noexcept
+    {
+        if (ptr)
+        {
+            dispatch::template visit<void>(type, address(), [](auto& d) {
+                using D = std::decay_t<decltype(d)>;
+                d.~D();
+            });
+            ptr = nullptr;
+            type = npos;
+        }
+    }
+
+    // Constructs the object of `i`, if it holds one of Ds, as that type;
+    // `forward` makes it a copy or a move.
+    template <typename I, typename F>
+    bool construct_from_indirect(I& i, F forward)
+    {
+        bool found = false;
+        using expand = int[];
+        (void)expand{0, (found || !i.template holds_type<Ds>()
+                             ? 0
+                             : (construct<Ds>(forward(*const_cast<Ds*>(detail::exact_downcast<Ds>(&*i, 0)))),
+                                found = true, 0))...};
+        return found;
+    }
+
+public:
+    using element_type = Base;
+
+    template <typename D = std::tuple_element_t<0, std::tuple<Ds...>>,
+              std::enable_if_t<std::is_default_constructible<D>::value, int> = 0>
+    closed_indirect()
+    {
+        construct<D>();
+    }
+
+    template <typename U, enable_if_member_t<U> = 0>
+    closed_indirect(U&& u)
+    {
+        construct<std::remove_cv_t<std::remove_reference_t<U>>>(std::forward<U>(u));
+    }
+
+    closed_indirect(closed_indirect const& other)
+    {
+        copy_from(other);
+    }
+
+    closed_indirect(closed_indirect&& other) noexcept(
+        detail::closed_all({std::is_nothrow_move_constructible<Ds>::value...}))
+    {
+        move_from(other);
+    }
+
+    // Copies the object held by `i`, which must be one of Ds, or stays
+    // empty if `i` is.
+    template <typename T, typename S>
+    explicit closed_indirect(indirect<T, S> const& i)
+    {
+        if (i && !construct_from_indirect(i, [](auto const& d) -> auto const& { return d; }))
+        {
+            detail::throw_bad_indirect_cast();
+        }
+    }
+
+    // Moves the object held by `i`, releasing its block.
+    template <typename T, typename S>
+    explicit closed_indirect(indirect<T, S>&& i)
+    {
+        if (i && !construct_from_indirect(i, [](auto& d) -> auto&& { return std::move(d); }))
+        {
+            detail::throw_bad_indirect_cast();
+        }
+        indirect<T, S> released(std::move(i));
+    }
+
+    ~closed_indirect()
+    {
+        reset();
+    }
+
+    // An object of the same type is assigned in place when that cannot
+    // throw; otherwise the old object is only destroyed once the copy is made.
+    closed_indirect& operator=(closed_indirect const& other)
+    {
+        if (this == &other)
+        {
+            return *this;
+        }
+        if (ptr && other.ptr && type == other.type)
+        {
+            bool assigned = dispatch::template visit<bool>(type, address(), [&](auto& d) {
+                using D = std::decay_t<decltype(d)>;
+                return assign(d, *static_cast<D const*>(other.address()), std::is_nothrow_copy_assignable<D>());
+            });
+            if (assigned)
+            {
+                return *this;
+            }
+        }
+        closed_indirect tmp(other);
+        return *this = std::move(tmp);
+    }
+
+    closed_indirect& operator=(closed_indirect&& other) noexcept(
+        detail::closed_all({std::is_nothrow_move_constructible<Ds>::value...}))
+    {
+        if (this != &other)
+        {
+            reset();
+            move_from(other);
+        }
+        return *this;
+    }
+
+    template <typename U, enable_if_member_t<U> = 0>
+    closed_indirect& operator=(U&& u)
+    {
+        closed_indirect tmp(std::forward<U>(u));
+        return *this = std::move(tmp);
+    }
+
+    // Replaces the object held by a U constructed from `ts...`; if that
+    // throws the `closed_indirect` is left empty.
+    template <typename U, typename... Ts, enable_if_member_t<U> = 0>
+    U& emplace(Ts&&... ts)
+    {
+        reset();
+        return construct<U>(std::forward<Ts>(ts)...);
+    }
+
+    void swap(closed_indirect& other) noexcept(
+        detail::closed_all({std::is_nothrow_move_constructible<Ds>::value...}))
+    {
+        closed_indirect tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+    // Copies the object held into an `indirect` of its own.
+    template <typename T, typename S,
+              std::enable_if_t<std::is_base_of<T, Base>::value && !std::is_same<S, exact_type>::value, int> = 0>
+    operator indirect<T, S>() const&
+    {
+        if (!ptr)
+        {
+            return detail::indirect_access::empty<T, S>();
+        }
+        return dispatch::template visit<indirect<T, S>>(type, address(),
+                                                        [](auto const& d) { return indirect<T, S>(d); });
+    }
+
+    template <typename T, typename S,
+              std::enable_if_t<std::is_base_of<T, Base>::value && !std::is_same<S, exact_type>::value, int> = 0>
+    operator indirect<T, S>() &&
+    {
+        if (!ptr)
+        {
+            return detail::indirect_access::empty<T, S>();
+        }
+        auto i = dispatch::template visit<indirect<T, S>>(type, address(),
+                                                          [](auto& d) { return indirect<T, S>(std::move(d)); });
+        reset();
+        return i;
+    }
+
+    Base const* operator->() const noexcept
+    {
+        return ptr;
+    }
+
+    Base* operator->() noexcept
+    {
+        return ptr;
+    }
+
+    Base const& operator*() const noexcept
+    {
+        return *ptr;
+    }
+
+    Base& operator*() noexcept
+    {
+        return *ptr;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return ptr != nullptr;
+    }
+
+    // The position of the type of the object held among Ds, or the number
+    // of Ds if empty.
+    std::size_t index() const noexcept
+    {
+        return type;
+    }
+
+    template <typename U>
+    bool holds_type() const noexcept
+    {
+        return ptr && type == index_of<U>::value;
+    }
+
+private:
+    template <typename D>
+    static bool assign(D& to, D const& from, std::true_type)
+    {
+        to = from;
+        return true;
+    }
+
+    template <typename D>
+    static bool assign(D&, D const&, std::false_type)
+    {
+        return false;
+    }
+
+    // The object of `c` as T, in the `closed_indirect` of the types of Ds
+    // derived from T; casting an object that is not a T throws.
+    template <typename T, typename C, typename F>
+    static detail::closed_cast_t<T, Ds...> cast(C& c, F forward)
+    {
+        using result = detail::closed_cast_t<T, Ds...>;
+        result r{typename result::empty_tag{}};
+        if (c.ptr)
+        {
+            dispatch::template visit<void>(c.type, c.address(), [&](auto& d) {
+                cast_into(r, forward(d), std::is_base_of<T, std::decay_t<decltype(d)>>());
+            });
+        }
+        return r;
+    }
+
+    template <typename R, typename D>
+    static void cast_into(R& r, D&& d, std::true_type)
+    {
+        r.template construct<std::decay_t<D>>(std::forward<D>(d));
+    }
+
+    template <typename R, typename D>
+    static void cast_into(R&, D&&, std::false_type)
+    {
+        detail::throw_bad_indirect_cast();
+    }
+
+    struct empty_tag
+    {
+    };
+
+    explicit closed_indirect(empty_tag) noexcept
+    {
+    }
+
+    template <typename T, typename B, typename... Es>
+    friend detail::closed_cast_t<T, Es...> static_indirect_cast(closed_indirect<B, Es...> const& c);
+    template <typename T, typename B, typename... Es>
+    friend detail::closed_cast_t<T, Es...> static_indirect_cast(closed_indirect<B, Es...>&& c);
+    template <typename T, typename B, typename... Es>
+    friend detail::closed_cast_t<T, Es...> dynamic_indirect_cast(closed_indirect<B, Es...> const& c);
+    template <typename T, typename B, typename... Es>
+    friend detail::closed_cast_t<T, Es...> dynamic_indirect_cast(closed_indirect<B, Es...>&& c);
+    template <typename T, typename B, typename... Es>
+    friend closed_indirect<T, T> exact_indirect_cast(closed_indirect<B, Es...>&& c);
+};
+
+// The dynamic type of the object of a `closed_indirect` is known from its
+// index, so a static cast checks it as a dynamic one does. The result holds
+// the types of the closed set that are derived from T.
+template <typename T, typename B, typename... Es>
+detail::closed_cast_t<T, Es...> static_indirect_cast(closed_indirect<B, Es...> const& c)
+{
+    return closed_indirect<B, Es...>::template cast<T>(c, [](auto& d) -> auto const& { return d; });
+}
+
+template <typename T, typename B, typename... Es>
+detail::closed_cast_t<T, Es...> static_indirect_cast(closed_indirect<B, Es...>&& c)
+{
+    auto r = closed_indirect<B, Es...>::template cast<T>(c, [](auto& d) -> auto&& { return std::move(d); });
+    c.reset();
+    return r;
+}
+
+template <typename T, typename B, typename... Es>
+detail::closed_cast_t<T, Es...> dynamic_indirect_cast(closed_indirect<B, Es...> const& c)
+{
+    return closed_indirect<B, Es...>::template cast<T>(c, [](auto& d) -> auto const& { return d; });
+}
+
+template <typename T, typename B, typename... Es>
+detail::closed_cast_t<T, Es...> dynamic_indirect_cast(closed_indirect<B, Es...>&& c)
+{
+    auto r = closed_indirect<B, Es...>::template cast<T>(c, [](auto& d) -> auto&& { return std::move(d); });
+    c.reset();
+    return r;
+}
+
+template <typename T, typename B, typename... Es>
+closed_indirect<T, T> exact_indirect_cast(closed_indirect<B, Es...> const& c)
+{
+    static_assert((detail::closed_index<T, Es...>::value < sizeof...(Es)), "T must be one of the closed set");
+    if (!c.template holds_type<T>())
+    {
+        detail::throw_bad_indirect_cast();
+    }
+    return closed_indirect<T, T>(*detail::exact_downcast<T>(&*c, 0));
+}
+
+template <typename T, typename B, typename... Es>
+closed_indirect<T, T> exact_indirect_cast(closed_indirect<B, Es...>&& c)
+{
+    static_assert((detail::closed_index<T, Es...>::value < sizeof...(Es)), "T must be one of the closed set");
+    if (!c.template holds_type<T>())
+    {
+        detail::throw_bad_indirect_cast();
+    }
+    closed_indirect<T, T> r(std::move(*const_cast<T*>(detail::exact_downcast<T>(&*c, 0))));
+    c.reset();
+    return r;
+}
+
+template <typename T, typename B, typename... Es>
+indirect_cast_view<T> exact_indirect_cast_view(closed_indirect<B, Es...> const& c) noexcept
+{
+    return indirect_cast_view<T>(c.template holds_type<T>() ? detail::exact_downcast<T>(&*c, 0) : nullptr);
+}
+
+template <typename T, typename B, typename... Es>
+void exact_indirect_cast_view(closed_indirect<B, Es...> const&&) = delete;
+
+template <typename Base, typename... Ds>
+void swap(closed_indirect<Base, Ds...>& a, closed_indirect<Base, Ds...>& b) noexcept(noexcept(a.swap(b)))
+{
+    a.swap(b);
+}
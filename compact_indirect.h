@@ -0,0 +1,379 @@
+#pragma once
+
+#include <indirect.h>
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// `compact_indirect<T>` is a one-pointer alternative to `indirect<T>`: the
+// block's type-erasure hooks live in a header immediately before the most
+// derived object, which is recovered from the object pointer. Converting
+// between `compact_indirect<U>` and `compact_indirect<T>` requires T to be
+// polymorphic (or the same type) so the most derived object can be found
+// with `dynamic_cast<void const*>`.
+template <typename T>
+class compact_indirect;
+
+namespace detail
+{
+
+    struct compact_vtable
+    {
+        void* (*copy)(void const* object);
+        void (*dispose)(void* object) noexcept;
+    };
+
+    struct compact_header
+    {
+        compact_vtable const* vtable;
+    };
+
+    inline compact_header const& header_of(void const* object) noexcept
+    {
+        return *reinterpret_cast<compact_header const*>(static_cast<char const*>(object) - sizeof(compact_header));
+    }
+
+    // Lays out [padding][compact_header][U] in one allocation so the header
+    // is at a fixed offset from the object whatever the alignment of U.
+    template <typename U>
+    struct compact_block
+    {
+        using value_type = U;
+
+        static constexpr char const* kind = "compact";
+        static constexpr std::size_t align = alignof(U) > alignof(compact_header) ? alignof(U) : alignof(compact_header);
+        static constexpr std::size_t offset = (sizeof(compact_header) + alignof(U) - 1) / alignof(U) * alignof(U);
+        static constexpr std::size_t size = offset + sizeof(U);
+
+        template <typename... Ts>
+        static U* create(Ts&&... ts)
+        {
+            auto memory = static_cast<char*>(allocate_bytes(size, align));
+            U* object;
+            INDIRECT_TRY
+            {
+                object = ::new (static_cast<void*>(memory + offset)) U(std::forward<Ts>(ts)...);
+            }
+            INDIRECT_CATCH_ALL
+            {
+                deallocate_bytes(memory, size, align);
+                INDIRECT_RETHROW;
+            }
+            ::new (static_cast<void*>(memory + offset - sizeof(compact_header))) compact_header{&vtable};
+            record_allocation<compact_block>(size);
+            return object;
+        }
+
+        static void* copy(void const* object)
+        {
+            auto copied = create(*static_cast<U const*>(object));
+            record<compact_block>(block_event::copy);
+            return copied;
+        }
+
+        static void dispose(void* object) noexcept
+        {
+            record<compact_block>(block_event::destroy);
+            static_cast<U*>(object)->~U();
+            deallocate_bytes(static_cast<char*>(object) - offset, size, align);
+            record_deallocation<compact_block>(size);
+        }
+
+        static constexpr compact_vtable vtable = {&copy, &dispose};
+    };
+
+    template <typename U>
+    constexpr compact_vtable compact_block<U>::vtable;
+
+    template <typename T>
+    void const* most_derived(T const* p, std::true_type) noexcept
+    {
+        return dynamic_cast<void const*>(p);
+    }
+
+    template <typename T>
+    void const* most_derived(T const* p, std::false_type) noexcept
+    {
+        return p;
+    }
+
+    template <typename T>
+    void const* most_derived(T const* p) noexcept
+    {
+        return most_derived(p, std::is_polymorphic<T>());
+    }
+
+    // The header of a block is only found from a `T const*` through a
+    // polymorphic `T`, or if `T` is the exact type.
+    template <typename T, typename U>
+    using compact_castable =
+        std::integral_constant<bool, std::is_polymorphic<T>::value ||
+                                         std::is_same<std::remove_cv_t<T>, std::remove_cv_t<U>>::value>;
+
+    template <typename T, typename U>
+    using compact_convertible = std::integral_constant<bool, std::is_base_of<T, U>::value && compact_castable<T, U>::value>;
+
+    template <typename T, typename U>
+    using compact_cast_t = std::enable_if_t<compact_castable<T, U>::value, compact_indirect<T>>;
+
+} // namespace detail
+
+template <typename T>
+class compact_indirect
+{
+    template <typename>
+    friend class compact_indirect;
+
+private:
+    T* ptr = nullptr;
+
+    template <typename U>
+    static T* convert(U* p) noexcept
+    {
+        return const_cast<T*>(static_cast<T const*>(p));
+    }
+
+    template <typename U>
+    static T* copy(U const* p)
+    {
+        if (!p)
+        {
+            return nullptr;
+        }
+        auto object = detail::most_derived(p);
+        auto copied = detail::header_of(object).vtable->copy(object);
+        return convert(detail::rebase(p, object, copied));
+    }
+
+    template <typename U, typename... Ts>
+    static T* create(Ts&&... ts)
+    {
+        auto object = detail::compact_block<U>::create(std::forward<Ts>(ts)...);
+        detail::record<detail::compact_block<U>>(detail::block_event::construct);
+        return convert(object);
+    }
+
+    void reset() noexcept
+    {
+        if (ptr)
+        {
+            auto object = const_cast<void*>(detail::most_derived(ptr));
+            detail::header_of(object).vtable->dispose(object);
+            ptr = nullptr;
+        }
+    }
+
+public:
+    template <typename T_ = T, std::enable_if_t<std::is_default_constructible<T_>::value, int> = 0>
+    compact_indirect() :
+        ptr(create<std::remove_cv_t<T>>())
+    {
+    }
+
+    template <typename... Ts>
+    explicit compact_indirect(in_place_t, Ts&&... ts) :
+        ptr(create<std::remove_cv_t<T>>(std::forward<Ts>(ts)...))
+    {
+    }
+
+    compact_indirect(compact_indirect const& other) :
+        ptr(copy(other.ptr))
+    {
+    }
+
+    compact_indirect(compact_indirect&& other) noexcept :
+        ptr(other.ptr)
+    {
+        other.ptr = nullptr;
+    }
+
+    ~compact_indirect()
+    {
+        reset();
+    }
+
+    compact_indirect& operator=(compact_indirect const& other)
+    {
+        if (this != &other)
+        {
+            T* p = copy(other.ptr);
+            reset();
+            ptr = p;
+        }
+        return *this;
+    }
+
+    compact_indirect& operator=(compact_indirect&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            ptr = other.ptr;
+            other.ptr = nullptr;
+        }
+        return *this;
+    }
+
+    template <typename U, std::enable_if_t<detail::compact_convertible<T, U>::value, int> = 0>
+    compact_indirect(compact_indirect<U> const& other) :
+        ptr(copy(other.ptr))
+    {
+    }
+
+    template <typename U, std::enable_if_t<detail::compact_convertible<T, U>::value, int> = 0>
+    compact_indirect(compact_indirect<U>&& other) noexcept :
+        ptr(convert(other.ptr))
+    {
+        other.ptr = nullptr;
+    }
+
+    template <typename U, std::enable_if_t<detail::compact_convertible<T, U>::value, int> = 0>
+    compact_indirect& operator=(compact_indirect<U> const& other)
+    {
+        T* p = copy(other.ptr);
+        reset();
+        ptr = p;
+        return *this;
+    }
+
+    template <typename U, std::enable_if_t<detail::compact_convertible<T, U>::value, int> = 0>
+    compact_indirect& operator=(compact_indirect<U>&& other) noexcept
+    {
+        reset();
+        ptr = convert(other.ptr);
+        other.ptr = nullptr;
+        return *this;
+    }
+
+    template <typename U, std::enable_if_t<detail::compact_convertible<T, std::remove_reference_t<U>>::value, int> = 0>
+    compact_indirect(U&& other) :
+        ptr(create<std::remove_cv_t<std::remove_reference_t<U>>>(std::forward<U>(other)))
+    {
+    }
+
+    template <typename U, std::enable_if_t<detail::compact_convertible<T, std::remove_reference_t<U>>::value, int> = 0>
+    compact_indirect& operator=(U&& other)
+    {
+        T* p = create<std::remove_cv_t<std::remove_reference_t<U>>>(std::forward<U>(other));
+        reset();
+        ptr = p;
+        return *this;
+    }
+
+    void swap(compact_indirect& other) noexcept
+    {
+        using std::swap;
+        swap(ptr, other.ptr);
+    }
+
+    T const* operator->() const noexcept
+    {
+        return ptr;
+    }
+
+    T* operator->() noexcept
+    {
+        return ptr;
+    }
+
+    T const& operator*() const noexcept
+    {
+        return *ptr;
+    }
+
+    T& operator*() noexcept
+    {
+        return *ptr;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return ptr != nullptr;
+    }
+
+private:
+    template <typename T_, typename U>
+    friend detail::compact_cast_t<T_, U> static_indirect_cast(compact_indirect<U> const& i);
+    template <typename T_, typename U>
+    friend detail::compact_cast_t<T_, U> static_indirect_cast(compact_indirect<U>&& i);
+    template <typename T_, typename U>
+    friend detail::compact_cast_t<T_, U> dynamic_indirect_cast(compact_indirect<U> const& i);
+    template <typename T_, typename U>
+    friend detail::compact_cast_t<T_, U> dynamic_indirect_cast(compact_indirect<U>&& i);
+
+    struct adopt_tag
+    {
+    };
+
+    compact_indirect(adopt_tag, T* p) noexcept :
+        ptr(p)
+    {
+    }
+
+    template <typename U>
+    static compact_indirect copied_from(U const* p)
+    {
+        return compact_indirect(adopt_tag{}, copy(p));
+    }
+
+    template <typename U>
+    static compact_indirect adopted_from(compact_indirect<U>& i, T const* p) noexcept
+    {
+        i.ptr = nullptr;
+        return compact_indirect(adopt_tag{}, const_cast<T*>(p));
+    }
+
+    template <typename U>
+    U const* checked_dynamic_cast() const
+    {
+        auto p = dynamic_cast<U const*>(ptr);
+        if (!p)
+        {
+            detail::throw_bad_indirect_cast();
+        }
+        return p;
+    }
+};
+
+template <typename T, typename... Ts>
+compact_indirect<T> make_compact_indirect(Ts&&... ts)
+{
+    return compact_indirect<T>(in_place, std::forward<Ts>(ts)...);
+}
+
+template <typename T, typename U>
+detail::compact_cast_t<T, U> static_indirect_cast(compact_indirect<U> const& i)
+{
+    return compact_indirect<T>::copied_from(static_cast<T const*>(i.ptr));
+}
+
+template <typename T, typename U>
+detail::compact_cast_t<T, U> static_indirect_cast(compact_indirect<U>&& i)
+{
+    return compact_indirect<T>::adopted_from(i, static_cast<T const*>(i.ptr));
+}
+
+template <typename T, typename U>
+detail::compact_cast_t<T, U> dynamic_indirect_cast(compact_indirect<U> const& i)
+{
+    return compact_indirect<T>::copied_from(i.template checked_dynamic_cast<T>());
+}
+
+template <typename T, typename U>
+detail::compact_cast_t<T, U> dynamic_indirect_cast(compact_indirect<U>&& i)
+{
+    return compact_indirect<T>::adopted_from(i, i.template checked_dynamic_cast<T>());
+}
+
+template <typename T>
+void swap(compact_indirect<T>& i1, compact_indirect<T>& i2) noexcept
+{
+    i1.swap(i2);
+}
+
+template <typename T>
+struct is_trivially_relocatable<compact_indirect<T>> : std::true_type
+{
+};
@@ -0,0 +1,463 @@
+#pragma once
+
+#include <indirect.h>
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+// `cow_indirect<T>` has the value semantics of `indirect<T>`, but copies share
+// one reference-counted block. Const access never copies; non-const
+// `operator->` and `operator*` first give the `cow_indirect` its own copy of
+// the object if the block is shared. Copies sharing a block can be made, read
+// and destroyed from any number of threads.
+template <typename T>
+class cow_indirect;
+
+// Specialize to `std::true_type` for a `T` whose `cow_indirect`s never leave
+// the thread that created them; their blocks are counted without atomics.
+// `cow_indirect`s can only be converted into one another when their types
+// agree on this trait.
+template <typename T>
+struct cow_thread_confined : std::false_type
+{
+};
+
+namespace detail
+{
+
+    // Copies only need the count to be incremented atomically. The last
+    // decrement must acquire every other owner's accesses to the object
+    // before it is destroyed, and each decrement releases the owner's own.
+    template <bool Confined>
+    class cow_count
+    {
+    private:
+        std::atomic<std::size_t> n{1};
+
+    public:
+        void acquire() noexcept
+        {
+            n.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        bool release() noexcept
+        {
+            return n.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
+
+        bool unique() const noexcept
+        {
+            return n.load(std::memory_order_acquire) == 1;
+        }
+
+        std::size_t get() const noexcept
+        {
+            return n.load(std::memory_order_relaxed);
+        }
+    };
+
+    template <>
+    class cow_count<true>
+    {
+    private:
+        std::size_t n = 1;
+
+    public:
+        void acquire() noexcept
+        {
+            ++n;
+        }
+
+        bool release() noexcept
+        {
+            return --n == 0;
+        }
+
+        bool unique() const noexcept
+        {
+            return n == 1;
+        }
+
+        std::size_t get() const noexcept
+        {
+            return n;
+        }
+    };
+
+    template <bool Confined>
+    struct cow_block;
+
+    template <bool Confined>
+    struct cow_vtable
+    {
+        cow_block<Confined>* (*clone)(cow_block<Confined> const& cb);
+        void (*dispose)(cow_block<Confined>& cb) noexcept;
+    };
+
+    template <bool Confined>
+    struct cow_block
+    {
+        cow_vtable<Confined> const* vtable;
+        cow_count<Confined> count;
+
+        void release() noexcept
+        {
+            if (count.release())
+            {
+                vtable->dispose(*this);
+            }
+        }
+    };
+
+    template <typename U, bool Confined>
+    class cow_control_block final : public cow_block<Confined>
+    {
+    private:
+        using block = cow_block<Confined>;
+
+        U u;
+
+        static block* clone(block const& cb)
+        {
+            auto b = create(static_cast<cow_control_block const&>(cb).u);
+            record<cow_control_block>(block_event::copy);
+            return b;
+        }
+
+        static void dispose(block& cb) noexcept
+        {
+            record<cow_control_block>(block_event::destroy);
+            delete static_cast<cow_control_block*>(&cb);
+            record_deallocation<cow_control_block>(sizeof(cow_control_block));
+        }
+
+        static constexpr cow_vtable<Confined> vtable = {&clone, &dispose};
+
+    public:
+        using value_type = U;
+
+        static constexpr char const* kind = "cow";
+
+        template <typename... Ts>
+        explicit cow_control_block(Ts&&... ts) :
+            block{&vtable, {}},
+            u(std::forward<Ts>(ts)...)
+        {
+        }
+
+        template <typename... Ts>
+        static cow_control_block* create(Ts&&... ts)
+        {
+            auto b = new cow_control_block(std::forward<Ts>(ts)...);
+            record_allocation<cow_control_block>(sizeof(cow_control_block));
+            return b;
+        }
+
+        U* get() noexcept
+        {
+            return &u;
+        }
+    };
+
+    template <typename U, bool Confined>
+    constexpr cow_vtable<Confined> cow_control_block<U, Confined>::vtable;
+
+    template <typename T, typename U>
+    using cow_convertible =
+        std::integral_constant<bool, std::is_base_of<T, U>::value &&
+                                         cow_thread_confined<T>::value == cow_thread_confined<U>::value>;
+
+} // namespace detail
+
+template <typename T>
+class cow_indirect
+{
+    template <typename>
+    friend class cow_indirect;
+
+private:
+    static constexpr bool confined = cow_thread_confined<T>::value;
+
+    using block_type = detail::cow_block<confined>;
+
+    template <typename U>
+    using control_block_type = detail::cow_control_block<U, confined>;
+
+    T* ptr = nullptr;
+    block_type* cb = nullptr;
+
+    template <typename U>
+    static T* convert(U* p) noexcept
+    {
+        return const_cast<T*>(static_cast<T const*>(p));
+    }
+
+    template <typename U, typename... Ts>
+    void emplace(Ts&&... ts)
+    {
+        auto b = control_block_type<U>::create(std::forward<Ts>(ts)...);
+        detail::record<control_block_type<U>>(detail::block_event::construct);
+        cb = b;
+        ptr = convert(b->get());
+    }
+
+    template <typename U>
+    void share(U* p, block_type* b) noexcept
+    {
+        if (b)
+        {
+            b->count.acquire();
+        }
+        reset();
+        ptr = convert(p);
+        cb = b;
+    }
+
+    template <typename U>
+    void steal(U*& p, block_type*& b) noexcept
+    {
+        reset();
+        ptr = convert(p);
+        cb = b;
+        p = nullptr;
+        b = nullptr;
+    }
+
+    void reset() noexcept
+    {
+        if (cb)
+        {
+            cb->release();
+        }
+        ptr = nullptr;
+        cb = nullptr;
+    }
+
+    // Gives this `cow_indirect` a block of its own before the object is
+    // exposed for modification.
+    void detach()
+    {
+        if (cb && !cb->count.unique())
+        {
+            auto b = cb->vtable->clone(*cb);
+            ptr = detail::rebase(ptr, cb, b);
+            cb->release();
+            cb = b;
+        }
+    }
+
+public:
+    template <typename T_ = T, std::enable_if_t<std::is_default_constructible<T_>::value, int> = 0>
+    cow_indirect()
+    {
+        emplace<std::remove_cv_t<T>>();
+    }
+
+    template <typename... Ts>
+    explicit cow_indirect(in_place_t, Ts&&... ts)
+    {
+        emplace<std::remove_cv_t<T>>(std::forward<Ts>(ts)...);
+    }
+
+    cow_indirect(cow_indirect const& other) noexcept
+    {
+        share(other.ptr, other.cb);
+    }
+
+    cow_indirect(cow_indirect&& other) noexcept
+    {
+        steal(other.ptr, other.cb);
+    }
+
+    ~cow_indirect()
+    {
+        reset();
+    }
+
+    cow_indirect& operator=(cow_indirect const& other) noexcept
+    {
+        share(other.ptr, other.cb);
+        return *this;
+    }
+
+    cow_indirect& operator=(cow_indirect&& other) noexcept
+    {
+        if (this != &other)
+        {
+            steal(other.ptr, other.cb);
+        }
+        return *this;
+    }
+
+    template <typename U, std::enable_if_t<detail::cow_convertible<T, U>::value, int> = 0>
+    cow_indirect(cow_indirect<U> const& other) noexcept
+    {
+        share(other.ptr, other.cb);
+    }
+
+    template <typename U, std::enable_if_t<detail::cow_convertible<T, U>::value, int> = 0>
+    cow_indirect(cow_indirect<U>&& other) noexcept
+    {
+        steal(other.ptr, other.cb);
+    }
+
+    template <typename U, std::enable_if_t<detail::cow_convertible<T, U>::value, int> = 0>
+    cow_indirect& operator=(cow_indirect<U> const& other) noexcept
+    {
+        share(other.ptr, other.cb);
+        return *this;
+    }
+
+    template <typename U, std::enable_if_t<detail::cow_convertible<T, U>::value, int> = 0>
+    cow_indirect& operator=(cow_indirect<U>&& other) noexcept
+    {
+        steal(other.ptr, other.cb);
+        return *this;
+    }
+
+    template <typename U, std::enable_if_t<std::is_base_of<T, std::remove_reference_t<U>>::value, int> = 0>
+    cow_indirect(U&& other)
+    {
+        emplace<std::remove_cv_t<std::remove_reference_t<U>>>(std::forward<U>(other));
+    }
+
+    template <typename U, std::enable_if_t<std::is_base_of<T, std::remove_reference_t<U>>::value, int> = 0>
+    cow_indirect& operator=(U&& other)
+    {
+        cow_indirect tmp(std::forward<U>(other));
+        swap(tmp);
+        return *this;
+    }
+
+    void swap(cow_indirect& other) noexcept
+    {
+        using std::swap;
+        swap(ptr, other.ptr);
+        swap(cb, other.cb);
+    }
+
+    T const* operator->() const noexcept
+    {
+        return ptr;
+    }
+
+    T* operator->()
+    {
+        detach();
+        return ptr;
+    }
+
+    T const& operator*() const noexcept
+    {
+        return *ptr;
+    }
+
+    T& operator*()
+    {
+        detach();
+        return *ptr;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return cb != nullptr;
+    }
+
+    // The number of `cow_indirect`s sharing this one's object; only a hint
+    // while other threads copy or destroy them.
+    std::size_t use_count() const noexcept
+    {
+        return cb ? cb->count.get() : 0;
+    }
+
+private:
+    template <typename T_, typename U>
+    friend cow_indirect<T_> static_indirect_cast(cow_indirect<U> const& i);
+    template <typename T_, typename U>
+    friend cow_indirect<T_> static_indirect_cast(cow_indirect<U>&& i);
+    template <typename T_, typename U>
+    friend cow_indirect<T_> dynamic_indirect_cast(cow_indirect<U> const& i);
+    template <typename T_, typename U>
+    friend cow_indirect<T_> dynamic_indirect_cast(cow_indirect<U>&& i);
+
+    struct empty_tag
+    {
+    };
+
+    explicit cow_indirect(empty_tag) noexcept
+    {
+    }
+
+    template <typename U>
+    static cow_indirect shared_from(cow_indirect<U> const& i, T const* p) noexcept
+    {
+        cow_indirect r{empty_tag{}};
+        r.share(p, i.cb);
+        return r;
+    }
+
+    template <typename U>
+    static cow_indirect adopted_from(cow_indirect<U>& i, T const* p) noexcept
+    {
+        cow_indirect r{empty_tag{}};
+        r.ptr = const_cast<T*>(p);
+        r.cb = i.cb;
+        i.ptr = nullptr;
+        i.cb = nullptr;
+        return r;
+    }
+
+    template <typename U>
+    U const* checked_dynamic_cast() const
+    {
+        auto p = dynamic_cast<U const*>(ptr);
+        if (!p)
+        {
+            detail::throw_bad_indirect_cast();
+        }
+        return p;
+    }
+};
+
+template <typename T, typename... Ts>
+cow_indirect<T> make_cow_indirect(Ts&&... ts)
+{
+    return cow_indirect<T>(in_place, std::forward<Ts>(ts)...);
+}
+
+template <typename T, typename U>
+cow_indirect<T> static_indirect_cast(cow_indirect<U> const& i)
+{
+    return cow_indirect<T>::shared_from(i, static_cast<T const*>(i.ptr));
+}
+
+template <typename T, typename U>
+cow_indirect<T> static_indirect_cast(cow_indirect<U>&& i)
+{
+    return cow_indirect<T>::adopted_from(i, static_cast<T const*>(i.ptr));
+}
+
+template <typename T, typename U>
+cow_indirect<T> dynamic_indirect_cast(cow_indirect<U> const& i)
+{
+    return cow_indirect<T>::shared_from(i, i.template checked_dynamic_cast<T>());
+}
+
+template <typename T, typename U>
+cow_indirect<T> dynamic_indirect_cast(cow_indirect<U>&& i)
+{
+    return cow_indirect<T>::adopted_from(i, i.template checked_dynamic_cast<T>());
+}
+
+template <typename T>
+void swap(cow_indirect<T>& i1, cow_indirect<T>& i2) noexcept
+{
+    i1.swap(i2);
+}
+
+template <typename T>
+struct is_trivially_relocatable<cow_indirect<T>> : std::true_type
+{
+};
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <indirect.h>
+
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+// `hashed_indirect<T>` is an `indirect<T>` that keeps the hash of its object
+// beside it once computed, for keys of hash containers whose objects are
+// expensive to hash. The hash is computed by `Hash` on first use and
+// forgotten on any non-const access to the object, so it cannot go stale;
+// copies keep it. Two `hashed_indirect`s whose hashes are both known and
+// differ compare unequal without comparing their objects.
+//
+// Computing the hash writes to the `hashed_indirect`, so a `const` one whose
+// hash is not yet known cannot be hashed from two threads at once; comparing
+// never computes it.
+template <typename T, typename Storage = heap_storage, typename Hash = std::hash<std::remove_cv_t<T>>>
+class hashed_indirect
+{
+private:
+    indirect<T, Storage> i;
+    mutable std::size_t cached = 0;
+    mutable bool hashed = false;
+
+    template <typename U>
+    using enable_if_object_t = std::enable_if_t<std::is_base_of<T, std::remove_reference_t<U>>::value, int>;
+
+public:
+    template <typename T_ = T, std::enable_if_t<std::is_default_constructible<T_>::value, int> = 0>
+    hashed_indirect()
+    {
+    }
+
+    template <typename... Ts>
+    explicit hashed_indirect(in_place_t, Ts&&... ts) :
+        i(in_place, std::forward<Ts>(ts)...)
+    {
+    }
+
+    hashed_indirect(indirect<T, Storage> other) noexcept :
+        i(std::move(other))
+    {
+    }
+
+    template <typename U, enable_if_object_t<U> = 0>
+    hashed_indirect(U&& other) :
+        i(std::forward<U>(other))
+    {
+    }
+
+    hashed_indirect(hashed_indirect const& other) = default;
+
+    hashed_indirect(hashed_indirect&& other) noexcept :
+        i(std::move(other.i)),
+        cached(other.cached),
+        hashed(other.hashed)
+    {
+        other.hashed = false;
+    }
+
+    hashed_indirect& operator=(hashed_indirect const& other) = default;
+
+    hashed_indirect& operator=(hashed_indirect&& other) noexcept(
+        std::is_nothrow_move_assignable<indirect<T, Storage>>::value)
+    {
+        if (this != &other)
+        {
+            i = std::move(other.i);
+            cached = other.cached;
+            hashed = other.hashed;
+            other.hashed = false;
+        }
+        return *this;
+    }
+
+    template <typename U, enable_if_object_t<U> = 0>
+    hashed_indirect& operator=(U&& other)
+    {
+        i = std::forward<U>(other);
+        hashed = false;
+        return *this;
+    }
+
+    template <typename U, typename... Ts, std::enable_if_t<std::is_base_of<T, U>::value, int> = 0>
+    U& emplace(Ts&&... ts)
+    {
+        hashed = false;
+        return i.template emplace<U>(std::forward<Ts>(ts)...);
+    }
+
+    void swap(hashed_indirect& other) noexcept(noexcept(i.swap(other.i)))
+    {
+        using std::swap;
+        i.swap(other.i);
+        swap(cached, other.cached);
+        swap(hashed, other.hashed);
+    }
+
+    T const* operator->() const noexcept
+    {
+        return i.operator->();
+    }
+
+    T* operator->() noexcept
+    {
+        hashed = false;
+        return i.operator->();
+    }
+
+    T const& operator*() const noexcept
+    {
+        return *i;
+    }
+
+    T& operator*() noexcept
+    {
+        hashed = false;
+        return *i;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return static_cast<bool>(i);
+    }
+
+    template <typename U>
+    bool holds_type() const noexcept
+    {
+        return i.template holds_type<U>();
+    }
+
+    indirect<T, Storage> const& get() const noexcept
+    {
+        return i;
+    }
+
+    // Moves the `indirect` out, leaving this empty.
+    indirect<T, Storage> release() noexcept
+    {
+        hashed = false;
+        return std::move(i);
+    }
+
+    // The hash of the object, 0 if empty, computed only if not known.
+    std::size_t hash() const
+    {
+        if (!hashed)
+        {
+            cached = i ? Hash()(*i) : 0;
+            hashed = true;
+        }
+        return cached;
+    }
+
+    bool hash_cached() const noexcept
+    {
+        return hashed;
+    }
+
+    friend bool operator==(hashed_indirect const& a, hashed_indirect const& b)
+    {
+        if (a.hashed && b.hashed && a.cached != b.cached)
+        {
+            return false;
+        }
+        return a.i == b.i;
+    }
+
+    friend bool operator!=(hashed_indirect const& a, hashed_indirect const& b)
+    {
+        return !(a == b);
+    }
+
+    friend bool operator<(hashed_indirect const& a, hashed_indirect const& b)
+    {
+        return a.i < b.i;
+    }
+
+    friend bool operator<=(hashed_indirect const& a, hashed_indirect const& b)
+    {
+        return a.i <= b.i;
+    }
+
+    friend bool operator>(hashed_indirect const& a, hashed_indirect const& b)
+    {
+        return a.i > b.i;
+    }
+
+    friend bool operator>=(hashed_indirect const& a, hashed_indirect const& b)
+    {
+        return a.i >= b.i;
+    }
+};
+
+template <typename T, typename S, typename H>
+void swap(hashed_indirect<T, S, H>& a, hashed_indirect<T, S, H>& b) noexcept(noexcept(a.swap(b)))
+{
+    a.swap(b);
+}
+
+namespace std
+{
+
+    template <typename T, typename S, typename H>
+    struct hash<::hashed_indirect<T, S, H>>
+    {
+        std::size_t operator()(::hashed_indirect<T, S, H> const& h) const
+        {
+            return h.hash();
+        }
+    };
+
+} // namespace std
@@ -1,258 +1,2200 @@
+#pragma once
+
+#include <indirect_instrumentation.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <memory>
+#include <new>
 #include <type_traits>
+#include <typeinfo>
+#include <utility>
+
+#if defined(__has_include)
+#if __has_include(<memory_resource>) && __cplusplus >= 201703L
+#include <memory_resource>
+#define INDIRECT_HAS_PMR 1
+#endif
+#endif
+
+// Without exceptions (`-fno-exceptions`) the blocks `indirect` allocates from
+// the free store are allocated with `std::nothrow`, and the `try_` functions
+// report a failed allocation with an empty `indirect`. Everything else that
+// would throw terminates instead.
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define INDIRECT_HAS_EXCEPTIONS 1
+#define INDIRECT_TRY try
+#define INDIRECT_CATCH_ALL catch (...)
+#define INDIRECT_CATCH_BAD_ALLOC catch (std::bad_alloc const&)
+#define INDIRECT_RETHROW throw
+#else
+#define INDIRECT_TRY if (true)
+#define INDIRECT_CATCH_ALL else
+#define INDIRECT_CATCH_BAD_ALLOC else
+#define INDIRECT_RETHROW
+#endif
+
+struct in_place_t
+{
+};
+
+constexpr in_place_t in_place;
+
+class bad_indirect_cast : public std::bad_cast
+{
+};
+
+// Storage policy for `indirect`: control blocks of up to `Size` bytes with
+// alignment up to `Align` whose object is nothrow move constructible are kept
+// inside the `indirect` itself, everything else goes on the free store.
+template <std::size_t Size, std::size_t Align = alignof(std::max_align_t)>
+struct inline_storage
+{
+    static constexpr std::size_t size = Size;
+    static constexpr std::size_t align = Align;
+};
+
+using heap_storage = inline_storage<0>;
+
+// Policy for an `indirect` that only ever holds an object of exactly type T:
+// the object is allocated on its own, without a control block, and copied by
+// T's copy constructor with no indirect call.
+struct exact_type
+{
+};
+
+template <typename T, typename Storage = heap_storage>
+class indirect;
+
+namespace detail
+{
+
+    struct indirect_access;
+
+    [[noreturn]] inline void throw_bad_indirect_cast()
+    {
+#ifdef INDIRECT_HAS_EXCEPTIONS
+        throw bad_indirect_cast();
+#else
+        std::abort();
+#endif
+    }
+
+    // Only without exceptions can an operation end without the block it
+    // needed; outside the `try_` functions that terminates, as a failed
+    // allocation does in the standard library.
+    inline void check_allocation(bool allocated) noexcept
+    {
+#ifndef INDIRECT_HAS_EXCEPTIONS
+        if (!allocated)
+        {
+            std::abort();
+        }
+#else
+        (void)allocated;
+#endif
+    }
+
+} // namespace detail
+
+#ifdef INDIRECT_HAS_PMR
+namespace pmr
+{
+
+    // Storage policy for `pmr::indirect`: control blocks are allocated from a
+    // `std::pmr::memory_resource` held by the `indirect`, which propagates like
+    // the resource of a `std::pmr::polymorphic_allocator`.
+    template <typename Storage = heap_storage>
+    struct resource_storage
+    {
+        static constexpr std::size_t size = Storage::size;
+        static constexpr std::size_t align = Storage::align;
+    };
+
+    template <typename T, typename Storage = heap_storage>
+    using indirect = ::indirect<T, resource_storage<Storage>>;
+
+} // namespace pmr
+#endif
+
+namespace detail
+{
+
+    struct control_block;
+
+    // Identifies the type of the object a block holds, whatever the kind of
+    // block, by one address per type.
+    using type_token = void const*;
+
+    template <typename T>
+    struct type_token_for
+    {
+        static constexpr char value = 0;
+    };
+
+    template <typename T>
+    constexpr char type_token_for<T>::value;
+
+    // Per-type table of the operations `indirect` performs on a control block.
+    // `copy` and `move` construct a new block in `buffer`, or allocate one the
+    // way the source block was allocated when `buffer` is null. `destroy` ends
+    // the lifetime of an inline block; `dispose` also releases its memory.
+    // `assign` copy-assigns the object of another block of the same type over
+    // the object of `to`; it is null unless that cannot throw. `type`
+    // identifies the dynamic type of the object in the block, and `memory`
+    // the way a block that is not inline was allocated. A `trivial` block is
+    // copied and relocated by copying its `size` bytes, into memory from
+    // `::operator new` when not inline, and needs no destruction before that
+    // memory is released; see `is_trivial_block`.
+    struct memory_class;
+
+    struct block_vtable
+    {
+        control_block* (*copy)(control_block const& cb, void* buffer);
+        control_block* (*move)(control_block& cb, void* buffer);
+        void (*destroy)(control_block& cb) noexcept;
+        void (*dispose)(control_block& cb) noexcept;
+        void (*assign)(control_block& to, control_block const& from) noexcept;
+        std::size_t size;
+        std::size_t align;
+        bool nothrow_move;
+        type_token type;
+        memory_class const* memory;
+        bool trivial;
+#ifdef INDIRECT_INSTRUMENTATION
+        // Records that the block's memory is taken over by a block of another type.
+        void (*record_reuse)() noexcept;
+#endif
+    };
+
+    // When instrumented, a block made by `make_indirect` with a call site,
+    // and every block copied or moved from it, refers to that site.
+    struct control_block
+    {
+        block_vtable const* vtable;
+#ifdef INDIRECT_INSTRUMENTATION
+        indirect_call_site const* site = nullptr;
+#endif
+    };
+
+#ifdef INDIRECT_INSTRUMENTATION
+    inline void record_site(control_block const& cb, block_event e) noexcept
+    {
+        if (cb.site)
+        {
+            cb.site->record(e);
+        }
+    }
+
+    // `to` is null if it could not be allocated.
+    inline void inherit_site(control_block* to, control_block const& from, block_event e) noexcept
+    {
+        if (to)
+        {
+            to->site = from.site;
+            record_site(from, e);
+        }
+    }
+#else
+    inline void record_site(control_block const&, block_event) noexcept
+    {
+    }
+
+    inline void inherit_site(control_block*, control_block const&, block_event) noexcept
+    {
+    }
+#endif
+
+    // Blocks of the same memory class are allocated alike, so the memory of
+    // one can hold another once the first is destroyed. `deallocate` releases
+    // that memory. Blocks without a class have a null `memory`.
+    struct memory_class
+    {
+        void (*deallocate)(void* p) noexcept;
+    };
+
+    template <typename Block>
+    struct memory_class_for
+    {
+        static constexpr memory_class const* value = nullptr;
+    };
+
+    template <typename Block>
+    constexpr memory_class const* memory_class_for<Block>::value;
+
+    // Whether `Block` can be handled as a `trivial` block. Only direct blocks
+    // of trivially copyable objects are, and none when instrumented, since
+    // the counters need every copy and destruction to go through the vtable.
+    template <typename Block>
+    struct is_trivial_block : std::false_type
+    {
+    };
+
+    template <typename Block, bool = std::is_nothrow_copy_assignable<typename Block::value_type>::value>
+    struct assign_for
+    {
+        static void assign(control_block& to, control_block const& from) noexcept
+        {
+            *static_cast<Block&>(to).get() = *static_cast<Block&>(const_cast<control_block&>(from)).get();
+            record<Block>(block_event::assign);
+            record_site(from, block_event::assign);
+        }
+
+        static constexpr void (*value)(control_block& to, control_block const& from) noexcept = &assign;
+    };
+
+    template <typename Block, bool Nothrow>
+    constexpr void (*assign_for<Block, Nothrow>::value)(control_block& to, control_block const& from) noexcept;
+
+    template <typename Block>
+    struct assign_for<Block, false>
+    {
+        static constexpr void (*value)(control_block& to, control_block const& from) noexcept = nullptr;
+    };
+
+    template <typename Block>
+    constexpr void (*assign_for<Block, false>::value)(control_block& to, control_block const& from) noexcept;
+
+    template <typename Block>
+    struct vtable_for
+    {
+        static control_block* copy(control_block const& cb, void* buffer)
+        {
+            auto b = static_cast<Block const&>(cb).clone(buffer);
+            record<Block>(block_event::copy);
+            inherit_site(b, cb, block_event::copy);
+            return b;
+        }
+
+        static control_block* move(control_block& cb, void* buffer)
+        {
+            auto b = static_cast<Block&>(cb).relocate(buffer);
+            record<Block>(block_event::move);
+            inherit_site(b, cb, block_event::move);
+            return b;
+        }
+
+        static void destroy(control_block& cb) noexcept
+        {
+            record<Block>(block_event::destroy);
+            record_site(cb, block_event::destroy);
+            static_cast<Block&>(cb).~Block();
+        }
+
+        static void dispose(control_block& cb) noexcept
+        {
+            record<Block>(block_event::destroy);
+            record_site(cb, block_event::destroy);
+            static_cast<Block&>(cb).dispose();
+        }
+
+#ifdef INDIRECT_INSTRUMENTATION
+        static void record_reuse() noexcept
+        {
+            record_deallocation<Block>(sizeof(Block));
+        }
+#endif
+
+        static constexpr block_vtable value = {&copy, &move, &destroy, &dispose, assign_for<Block>::value,
+                                               sizeof(Block), alignof(Block), Block::nothrow_move,
+                                               &type_token_for<typename Block::value_type>::value,
+                                               memory_class_for<Block>::value, is_trivial_block<Block>::value
+#ifdef INDIRECT_INSTRUMENTATION
+                                               ,
+                                               &record_reuse
+#endif
+        };
+    };
+
+    template <typename Block>
+    constexpr block_vtable vtable_for<Block>::value;
+
+    template <typename Block>
+    constexpr bool fits_inline(std::size_t size, std::size_t align) noexcept
+    {
+        return sizeof(Block) <= size && alignof(Block) <= align && Block::nothrow_move;
+    }
+
+    // Copies the bytes of a `trivial` block into `buffer`, or into memory of
+    // its own if `buffer` is null; the copy is null only if allocating that
+    // failed without exceptions.
+    template <typename Block>
+    Block* copy_trivial(Block const& b, void* buffer)
+    {
+        if (!buffer)
+        {
+#ifdef INDIRECT_HAS_EXCEPTIONS
+            buffer = ::operator new(sizeof(Block));
+#else
+            buffer = ::operator new(sizeof(Block), std::nothrow);
+            if (!buffer)
+            {
+                return nullptr;
+            }
+#endif
+        }
+        std::memcpy(buffer, static_cast<void const*>(&b), sizeof(Block));
+        return static_cast<Block*>(buffer);
+    }
+
+    template <typename T>
+    class direct_control_block final : public control_block
+    {
+        template <typename>
+        friend struct vtable_for;
+
+    private:
+        T t;
+
+        using trivial = is_trivial_block<direct_control_block>;
+
+        direct_control_block* clone(void* buffer) const
+        {
+            return clone(buffer, trivial());
+        }
+
+        direct_control_block* clone(void* buffer, std::false_type) const
+        {
+            return create(buffer, t);
+        }
+
+        direct_control_block* clone(void* buffer, std::true_type) const
+        {
+            return copy_trivial(*this, buffer);
+        }
+
+        direct_control_block* relocate(void* buffer)
+        {
+            return relocate(buffer, trivial());
+        }
+
+        direct_control_block* relocate(void* buffer, std::false_type)
+        {
+            return create(buffer, std::move(t));
+        }
+
+        direct_control_block* relocate(void* buffer, std::true_type)
+        {
+            return copy_trivial(*this, buffer);
+        }
+
+        void dispose() noexcept
+        {
+            delete this;
+            record_deallocation<direct_control_block>(sizeof(direct_control_block));
+        }
+
+    public:
+        using value_type = T;
+
+        static constexpr char const* kind = "direct";
+        static constexpr bool nothrow_move = std::is_nothrow_move_constructible<T>::value;
+
+        template <typename... Ts>
+        explicit direct_control_block(Ts&&... ts) :
+            control_block{&vtable_for<direct_control_block>::value},
+            t(std::forward<Ts>(ts)...)
+        {
+        }
+
+        static constexpr bool fits(std::size_t size, std::size_t align) noexcept
+        {
+            return fits_inline<direct_control_block>(size, align);
+        }
+
+        template <typename... Ts>
+        static direct_control_block* create(void* buffer, Ts&&... ts)
+        {
+            if (buffer)
+            {
+                return ::new (buffer) direct_control_block(std::forward<Ts>(ts)...);
+            }
+#ifdef INDIRECT_HAS_EXCEPTIONS
+            auto b = new direct_control_block(std::forward<Ts>(ts)...);
+#else
+            auto b = new (std::nothrow) direct_control_block(std::forward<Ts>(ts)...);
+            if (!b)
+            {
+                return nullptr;
+            }
+#endif
+            record_allocation<direct_control_block>(sizeof(direct_control_block));
+            return b;
+        }
+
+        static bool holds(control_block const& cb) noexcept
+        {
+            return cb.vtable == &vtable_for<direct_control_block>::value;
+        }
+
+        T* get() noexcept
+        {
+            return &t;
+        }
+
+        T const& value() const noexcept
+        {
+            return t;
+        }
+    };
+
+#ifndef INDIRECT_INSTRUMENTATION
+    template <typename T>
+    struct is_trivial_block<direct_control_block<T>>
+        : std::integral_constant<bool, std::is_trivially_copyable<direct_control_block<T>>::value &&
+                                           alignof(direct_control_block<T>) <= alignof(std::max_align_t)>
+    {
+    };
+#endif
+
+    // Direct blocks come from the free store, which takes back any block of
+    // the size it was allocated for; over-aligned ones are left out.
+    template <std::size_t Size>
+    struct heap_memory
+    {
+        static void deallocate(void* p) noexcept
+        {
+            ::operator delete(p);
+        }
+
+        static constexpr memory_class value = {&deallocate};
+    };
+
+    template <std::size_t Size>
+    constexpr memory_class heap_memory<Size>::value;
+
+    template <typename T>
+    struct memory_class_for<direct_control_block<T>>
+    {
+        static constexpr memory_class const* value =
+            alignof(direct_control_block<T>) <= alignof(std::max_align_t)
+                ? &heap_memory<sizeof(direct_control_block<T>)>::value
+                : nullptr;
+    };
+
+    template <typename T>
+    constexpr memory_class const* memory_class_for<direct_control_block<T>>::value;
+
+    // A control block allocated by, and holding a copy of, a user-supplied
+    // allocator. Copies are allocated by the allocator returned from
+    // `select_on_container_copy_construction`.
+    template <typename T, typename A>
+    class allocator_control_block final : public control_block
+    {
+        template <typename>
+        friend struct vtable_for;
+
+    public:
+        using allocator_type = typename std::allocator_traits<A>::template rebind_alloc<allocator_control_block>;
+
+    private:
+        using traits = std::allocator_traits<allocator_type>;
+
+        allocator_type alloc;
+        T t;
+
+        allocator_control_block* clone(void* buffer) const
+        {
+            return create(buffer, traits::select_on_container_copy_construction(alloc), t);
+        }
+
+        allocator_control_block* relocate(void* buffer)
+        {
+            return create(buffer, alloc, std::move(t));
+        }
+
+        void dispose() noexcept
+        {
+            allocator_type a(alloc);
+            auto p = std::pointer_traits<typename traits::pointer>::pointer_to(*this);
+            this->~allocator_control_block();
+            traits::deallocate(a, p, 1);
+            record_deallocation<allocator_control_block>(sizeof(allocator_control_block));
+        }
+
+    public:
+        using value_type = T;
+
+        static constexpr char const* kind = "allocator";
+        static constexpr bool nothrow_move = std::is_nothrow_move_constructible<T>::value;
+
+        template <typename... Ts>
+        explicit allocator_control_block(allocator_type const& a, Ts&&... ts) :
+            control_block{&vtable_for<allocator_control_block>::value},
+            alloc(a),
+            t(std::forward<Ts>(ts)...)
+        {
+        }
+
+        static constexpr bool fits(std::size_t size, std::size_t align) noexcept
+        {
+            return fits_inline<allocator_control_block>(size, align);
+        }
+
+        template <typename... Ts>
+        static allocator_control_block* create(void* buffer, allocator_type const& a, Ts&&... ts)
+        {
+            if (buffer)
+            {
+                return ::new (buffer) allocator_control_block(a, std::forward<Ts>(ts)...);
+            }
+            allocator_type a_(a);
+            auto p = traits::allocate(a_, 1);
+            INDIRECT_TRY
+            {
+                auto b = ::new (static_cast<void*>(std::addressof(*p))) allocator_control_block(a_, std::forward<Ts>(ts)...);
+                record_allocation<allocator_control_block>(sizeof(allocator_control_block));
+                return b;
+            }
+            INDIRECT_CATCH_ALL
+            {
+                traits::deallocate(a_, p, 1);
+                INDIRECT_RETHROW;
+            }
+        }
+
+        T* get() noexcept
+        {
+            return &t;
+        }
+
+        allocator_type const& get_allocator() const noexcept
+        {
+            return alloc;
+        }
+    };
+
+#ifdef INDIRECT_HAS_PMR
+    // Blocks of a `pmr::indirect` can also be copied or moved into a given
+    // memory resource; `base` is the first member so a `block_vtable const*`
+    // can be converted back.
+    struct resource_block_vtable
+    {
+        block_vtable base;
+        control_block* (*copy)(control_block const& cb, void* buffer, std::pmr::memory_resource* r);
+        control_block* (*move)(control_block& cb, void* buffer, std::pmr::memory_resource* r);
+    };
+
+    inline resource_block_vtable const& resource_vtable(control_block const& cb) noexcept
+    {
+        return *reinterpret_cast<resource_block_vtable const*>(cb.vtable);
+    }
+
+    template <typename Block>
+    struct resource_vtable_for
+    {
+        static control_block* copy(control_block const& cb, void* buffer, std::pmr::memory_resource* r)
+        {
+            return static_cast<Block const&>(cb).clone(buffer, r);
+        }
+
+        static control_block* move(control_block& cb, void* buffer, std::pmr::memory_resource* r)
+        {
+            return static_cast<Block&>(cb).relocate(buffer, r);
+        }
+
+        static constexpr resource_block_vtable value = {vtable_for<Block>::value, &copy, &move};
+    };
+
+    template <typename Block>
+    constexpr resource_block_vtable resource_vtable_for<Block>::value;
+
+    template <typename T>
+    class resource_control_block final : public control_block
+    {
+        template <typename>
+        friend struct vtable_for;
+        template <typename>
+        friend struct resource_vtable_for;
+
+    private:
+        std::pmr::memory_resource* resource;
+        T t;
+
+        resource_control_block* clone(void* buffer) const
+        {
+            return create(buffer, std::pmr::get_default_resource(), t);
+        }
+
+        resource_control_block* relocate(void* buffer)
+        {
+            return create(buffer, resource, std::move(t));
+        }
+
+        resource_control_block* clone(void* buffer, std::pmr::memory_resource* r) const
+        {
+            return create(buffer, r, t);
+        }
+
+        resource_control_block* relocate(void* buffer, std::pmr::memory_resource* r)
+        {
+            return create(buffer, r, std::move(t));
+        }
+
+        void dispose() noexcept
+        {
+            auto r = resource;
+            this->~resource_control_block();
+            r->deallocate(this, sizeof(resource_control_block), alignof(resource_control_block));
+            record_deallocation<resource_control_block>(sizeof(resource_control_block));
+        }
+
+    public:
+        using value_type = T;
+
+        static constexpr char const* kind = "resource";
+        static constexpr bool nothrow_move = std::is_nothrow_move_constructible<T>::value;
+
+        template <typename... Ts>
+        explicit resource_control_block(std::pmr::memory_resource* r, Ts&&... ts) :
+            control_block{&resource_vtable_for<resource_control_block>::value.base},
+            resource(r),
+            t(std::forward<Ts>(ts)...)
+        {
+        }
+
+        static constexpr bool fits(std::size_t size, std::size_t align) noexcept
+        {
+            return fits_inline<resource_control_block>(size, align);
+        }
+
+        template <typename... Ts>
+        static resource_control_block* create(void* buffer, std::pmr::memory_resource* r, Ts&&... ts)
+        {
+            if (buffer)
+            {
+                return ::new (buffer) resource_control_block(r, std::forward<Ts>(ts)...);
+            }
+            void* p = r->allocate(sizeof(resource_control_block), alignof(resource_control_block));
+            INDIRECT_TRY
+            {
+                auto b = ::new (p) resource_control_block(r, std::forward<Ts>(ts)...);
+                record_allocation<resource_control_block>(sizeof(resource_control_block));
+                return b;
+            }
+            INDIRECT_CATCH_ALL
+            {
+                r->deallocate(p, sizeof(resource_control_block), alignof(resource_control_block));
+                INDIRECT_RETHROW;
+            }
+        }
+
+        T* get() noexcept
+        {
+            return &t;
+        }
+    };
+#endif
+
+    inline void* allocate_bytes(std::size_t size, std::size_t align)
+    {
+#ifdef __cpp_aligned_new
+        if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+        {
+            return ::operator new(size, std::align_val_t(align));
+        }
+#endif
+        (void)align;
+        return ::operator new(size);
+    }
+
+    inline void deallocate_bytes(void* p, std::size_t size, std::size_t align) noexcept
+    {
+#ifdef __cpp_aligned_new
+        if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+        {
+            ::operator delete(p, size, std::align_val_t(align));
+            return;
+        }
+#endif
+        (void)size;
+        (void)align;
+        ::operator delete(p);
+    }
+
+    // The dynamic type of `*p` is U, so a static downcast is exact unless T
+    // is a virtual base of U.
+    template <typename U, typename T>
+    auto exact_downcast(T const* p, int) noexcept -> decltype(static_cast<U const*>(p))
+    {
+        return static_cast<U const*>(p);
+    }
+
+    template <typename U, typename T>
+    U const* exact_downcast(T const* p, long) noexcept
+    {
+        return dynamic_cast<U const*>(p);
+    }
+
+    template <typename T>
+    T* rebase(T* p, void const* from, void* to) noexcept
+    {
+        auto offset = reinterpret_cast<char const*>(p) - static_cast<char const*>(from);
+        return reinterpret_cast<T*>(static_cast<char*>(to) + offset);
+    }
+
+    template <typename T>
+    using dcb_t = direct_control_block<std::remove_cv_t<std::remove_reference_t<T>>>;
+
+    template <std::size_t Size, std::size_t Align>
+    class inline_buffer
+    {
+    private:
+        alignas(Align) unsigned char bytes[Size];
+
+    public:
+        void* address() noexcept
+        {
+            return bytes;
+        }
+
+        void const* address() const noexcept
+        {
+            return bytes;
+        }
+    };
+
+    template <std::size_t Align>
+    class inline_buffer<0, Align>
+    {
+    public:
+        void* address() noexcept
+        {
+            return nullptr;
+        }
+
+        void const* address() const noexcept
+        {
+            return nullptr;
+        }
+    };
+
+    // Decides where a `block_storage` allocates control blocks and whether
+    // blocks can be handed over between two storages.
+    template <typename Storage>
+    class block_allocation
+    {
+    public:
+        static constexpr bool always_equal = true;
+
+        template <typename U>
+        using block_type = direct_control_block<U>;
+
+        template <typename U, typename... Ts>
+        direct_control_block<U>* emplace(void* buffer, Ts&&... ts) const
+        {
+            using block = direct_control_block<U>;
+            auto b = block::create(block::fits(Storage::size, Storage::align) ? buffer : nullptr,
+                                   std::forward<Ts>(ts)...);
+            if (b)
+            {
+                record<block>(block_event::construct);
+            }
+            return b;
+        }
+
+        template <typename U, typename A, typename... Ts>
+        allocator_control_block<U, A>* allocate(void* buffer, A const& a, Ts&&... ts) const
+        {
+            using block = allocator_control_block<U, A>;
+            auto b = block::create(block::fits(Storage::size, Storage::align) ? buffer : nullptr,
+                                   typename block::allocator_type(a), std::forward<Ts>(ts)...);
+            record<block>(block_event::construct);
+            return b;
+        }
+
+        // A `Static` that is final must be the dynamic type, so a direct block
+        // holding one is copied without going through the vtable.
+        template <typename Static>
+        control_block* copy(control_block const& cb, void* buffer) const
+        {
+            return copy(cb, buffer, static_cast<Static*>(nullptr), std::is_final<Static>());
+        }
+
+        control_block* move(control_block& cb, void* buffer) const
+        {
+            return cb.vtable->move(cb, buffer);
+        }
+
+        bool equals(block_allocation const&) const noexcept
+        {
+            return true;
+        }
+
+    private:
+        template <typename Static>
+        control_block* copy(control_block const& cb, void* buffer, Static*, std::false_type) const
+        {
+            return cb.vtable->copy(cb, buffer);
+        }
+
+        template <typename Static>
+        control_block* copy(control_block const& cb, void* buffer, Static*, std::true_type) const
+        {
+            using block = direct_control_block<std::remove_cv_t<Static>>;
+            if (block::holds(cb))
+            {
+                auto b = block::create(buffer, static_cast<block const&>(cb).value());
+                record<block>(block_event::copy);
+                inherit_site(b, cb, block_event::copy);
+                return b;
+            }
+            return cb.vtable->copy(cb, buffer);
+        }
+    };
+
+#ifdef INDIRECT_HAS_PMR
+    template <typename Storage>
+    class block_allocation<pmr::resource_storage<Storage>>
+    {
+    private:
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+
+    public:
+        static constexpr bool always_equal = false;
+
+        block_allocation() = default;
+
+        template <typename A>
+        block_allocation(std::allocator_arg_t, A const& a) :
+            resource(std::pmr::polymorphic_allocator<std::byte>(a).resource())
+        {
+        }
+
+        template <typename U>
+        using block_type = resource_control_block<U>;
+
+        template <typename U, typename... Ts>
+        resource_control_block<U>* emplace(void* buffer, Ts&&... ts) const
+        {
+            using block = resource_control_block<U>;
+            auto b = block::create(block::fits(Storage::size, Storage::align) ? buffer : nullptr, resource,
+                                   std::forward<Ts>(ts)...);
+            record<block>(block_event::construct);
+            return b;
+        }
+
+        template <typename U, typename A, typename... Ts>
+        resource_control_block<U>* allocate(void* buffer, A const& a, Ts&&... ts)
+        {
+            resource = std::pmr::polymorphic_allocator<std::byte>(a).resource();
+            return emplace<U>(buffer, std::forward<Ts>(ts)...);
+        }
+
+        template <typename Static>
+        control_block* copy(control_block const& cb, void* buffer) const
+        {
+            return resource_vtable(cb).copy(cb, buffer, resource);
+        }
+
+        control_block* move(control_block& cb, void* buffer) const
+        {
+            return resource_vtable(cb).move(cb, buffer, resource);
+        }
+
+        bool equals(block_allocation const& other) const noexcept
+        {
+            return resource == other.resource || resource->is_equal(*other.resource);
+        }
+
+        std::pmr::memory_resource* get_resource() const noexcept
+        {
+            return resource;
+        }
+    };
+#endif
+
+    // Owns a control block that lives either in the inline buffer or on the
+    // free store. Copy construction starts from a default `block_allocation`,
+    // move construction propagates it and assignment keeps the destination's.
+    template <typename Storage>
+    class block_storage : private inline_buffer<Storage::size, Storage::align>, private block_allocation<Storage>
+    {
+    private:
+        using allocation = block_allocation<Storage>;
+
+        control_block* cb = nullptr;
+
+    public:
+        static constexpr bool always_equal = allocation::always_equal;
+
+        block_storage() = default;
+
+        template <typename A>
+        block_storage(std::allocator_arg_t, A const& a) :
+            allocation(std::allocator_arg, a)
+        {
+        }
+
+        block_storage(block_storage const& other)
+        {
+            copy_from(other);
+        }
+
+        block_storage(block_storage&& other) noexcept :
+            allocation(other)
+        {
+            take(other);
+        }
+
+        block_storage& operator=(block_storage const& other)
+        {
+            if (this != &other)
+            {
+                block_storage tmp = empty_like();
+                tmp.copy_from(other);
+                reset();
+                take(tmp);
+            }
+            return *this;
+        }
+
+        block_storage& operator=(block_storage&& other) noexcept(always_equal)
+        {
+            if (this == &other)
+            {
+                return *this;
+            }
+            if (allocation::equals(other))
+            {
+                reset();
+                take(other);
+            }
+            else
+            {
+                block_storage tmp = empty_like();
+                tmp.cb = other.cb ? tmp.allocation::move(*other.cb, tmp.buffer_for(*other.cb)) : nullptr;
+                other.reset();
+                reset();
+                take(tmp);
+            }
+            return *this;
+        }
+
+        ~block_storage()
+        {
+            reset();
+        }
+
+        // An empty storage that allocates the way this one does.
+        block_storage empty_like() const noexcept
+        {
+            return block_storage(static_cast<allocation const&>(*this));
+        }
+
+        template <typename U, typename... Ts>
+        U* emplace(Ts&&... ts)
+        {
+            auto b = allocation::template emplace<U>(this->address(), std::forward<Ts>(ts)...);
+            cb = b;
+            return b ? b->get() : nullptr;
+        }
+
+        template <typename U, typename A, typename... Ts>
+        U* allocate(A const& a, Ts&&... ts)
+        {
+            auto b = allocation::template allocate<U>(this->address(), a, std::forward<Ts>(ts)...);
+            cb = b;
+            return b->get();
+        }
+
+        // Destroys the object held and creates a block holding a U in its
+        // place. A U that is not stored inline reuses the memory of the old
+        // block when that was allocated the way a U block would be. If
+        // constructing the U throws, the storage is left empty.
+        template <typename U, typename... Ts>
+        U* replace(Ts&&... ts)
+        {
+            using block = typename allocation::template block_type<U>;
+            auto memory = vtable_for<block>::value.memory;
+            if (!memory || is_inline() || !cb || cb->vtable->memory != memory ||
+                block::fits(Storage::size, Storage::align))
+            {
+                reset();
+                return emplace<U>(std::forward<Ts>(ts)...);
+            }
+            void* p = cb;
+#ifdef INDIRECT_INSTRUMENTATION
+            // Memory taken over by a block of another type is counted as
+            // freed by the old type and allocated by the new.
+            auto reused = cb->vtable->type != &type_token_for<typename block::value_type>::value;
+            if (reused)
+            {
+                cb->vtable->record_reuse();
+            }
+#endif
+            if (!cb->vtable->trivial)
+            {
+                cb->vtable->destroy(*cb);
+            }
+            cb = nullptr;
+            INDIRECT_TRY
+            {
+                auto b = block::create(p, std::forward<Ts>(ts)...);
+#ifdef INDIRECT_INSTRUMENTATION
+                if (reused)
+                {
+                    record_allocation<block>(sizeof(block));
+                }
+#endif
+                record<block>(block_event::construct);
+                cb = b;
+                return b->get();
+            }
+            INDIRECT_CATCH_ALL
+            {
+                memory->deallocate(p);
+                INDIRECT_RETHROW;
+            }
+        }
+
+        // Takes ownership of a block created elsewhere in the way this
+        // storage allocates.
+        void adopt(control_block* b) noexcept
+        {
+            cb = b;
+        }
+
+        // Copies the object held by `other`, whose static type is `Static`,
+        // into this empty storage.
+        template <typename Static = void>
+        void copy_from(block_storage const& other)
+        {
+            cb = other.cb ? allocation::template copy<Static>(*other.cb, buffer_for(*other.cb)) : nullptr;
+        }
+
+        void reset() noexcept
+        {
+            if (!cb)
+            {
+                return;
+            }
+            if (cb->vtable->trivial)
+            {
+                if (!is_inline())
+                {
+                    ::operator delete(cb);
+                }
+            }
+            else if (is_inline())
+            {
+                cb->vtable->destroy(*cb);
+            }
+            else
+            {
+                cb->vtable->dispose(*cb);
+            }
+            cb = nullptr;
+        }
+
+        bool is_inline() const noexcept
+        {
+            return Storage::size != 0 && cb && cb == this->address();
+        }
+
+        // Blocks created from one another have the same layout, so objects are
+        // relocated between them by their offset from the block.
+        void* block() const noexcept
+        {
+            return cb;
+        }
+
+        allocation const& get_allocation() const noexcept
+        {
+            return *this;
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return cb != nullptr;
+        }
+
+        bool holds(type_token type) const noexcept
+        {
+            return cb && cb->vtable->type == type;
+        }
+
+        // Null when empty.
+        type_token type() const noexcept
+        {
+            return cb ? cb->vtable->type : nullptr;
+        }
+
+        // Copy-assigns the object held by `other` over this one's, keeping
+        // this block, when both are the same kind of block and the assignment
+        // cannot throw.
+        bool assign_from(block_storage const& other) noexcept
+        {
+            if (cb && other.cb && cb->vtable == other.cb->vtable && cb->vtable->assign)
+            {
+                cb->vtable->assign(*cb, *other.cb);
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        explicit block_storage(allocation const& a) noexcept :
+            allocation(a)
+        {
+        }
+
+        void* buffer_for(control_block const& other) noexcept
+        {
+            auto const& vt = *other.vtable;
+            bool fits = vt.size <= Storage::size && vt.align <= Storage::align && vt.nothrow_move;
+            return fits ? this->address() : nullptr;
+        }
+
+        void take(block_storage& other) noexcept
+        {
+            if (other.is_inline())
+            {
+                cb = allocation::move(*other.cb, this->address());
+                other.reset();
+            }
+            else
+            {
+                cb = other.cb;
+                other.cb = nullptr;
+            }
+        }
+    };
+
+} // namespace detail
+
+template <typename U, typename Storage>
+struct is_inline_storable
+    : std::integral_constant<bool, detail::dcb_t<U>::fits(Storage::size, Storage::align)>
+{
+};
+
+template <typename T, typename Storage>
+class indirect
+{
+    template <typename, typename>
+    friend class indirect;
+    friend struct detail::indirect_access;
+
+private:
+    using storage_type = detail::block_storage<Storage>;
+
+    struct data
+    {
+        T* ptr = nullptr;
+        storage_type cb;
+
+        data() = default;
+
+        explicit data(storage_type&& cb_) noexcept :
+            cb(std::move(cb_))
+        {
+        }
+
+        data(data&& other, void const* from) noexcept :
+            cb(std::move(other.cb))
+        {
+            ptr = relocate(other.ptr, from);
+            other.ptr = nullptr;
+        }
+
+        data(data const& other)
+        {
+            copy_from(other.cb, other.ptr);
+        }
+
+        // The block is move constructed, so it keeps the source's allocator
+        // instead of moving the object into a default-constructed one.
+        data(data&& other) noexcept :
+            data(std::move(other), other.cb.block())
+        {
+        }
+
+        data& operator=(data const& other)
+        {
+            if (this != &other)
+            {
+                assign_from(other.cb, other.ptr);
+            }
+            return *this;
+        }
+
+        // Reuses this block for an object of the same type, else copies
+        // into a new one before releasing this.
+        template <typename U>
+        void assign_from(storage_type const& other, U* p)
+        {
+            if (cb.assign_from(other))
+            {
+                ptr = relocate(p, other.block());
+                return;
+            }
+            data tmp(cb.empty_like());
+            tmp.copy_from(other, p);
+            *this = std::move(tmp);
+        }
+
+        data& operator=(data&& other) noexcept(storage_type::always_equal)
+        {
+            if (this != &other)
+            {
+                void* from = other.cb.block();
+                T* p = other.ptr;
+                cb = std::move(other.cb);
+                ptr = relocate(p, from);
+                other.ptr = nullptr;
+            }
+            return *this;
+        }
+
+        // Null if `cb` is empty, which without exceptions it is when the block
+        // could not be allocated.
+        template <typename U>
+        T* relocate(U* p, void const* from) noexcept
+        {
+            auto to = cb.block();
+            return to ? convert(detail::rebase(p, from, to)) : nullptr;
+        }
+
+        // `p` points into the object held by `other`.
+        template <typename U>
+        void copy_from(storage_type const& other, U* p)
+        {
+            try_copy_from(other, p);
+            detail::check_allocation(ptr || !p);
+        }
+
+        template <typename U>
+        void try_copy_from(storage_type const& other, U* p)
+        {
+            cb.template copy_from<U>(other);
+            ptr = relocate(p, other.block());
+        }
+
+
+        template <typename U, typename... Ts>
+        void emplace(Ts&&... ts)
+        {
+            try_emplace<U>(std::forward<Ts>(ts)...);
+            detail::check_allocation(ptr);
+        }
+
+        template <typename U, typename... Ts>
+        void try_emplace(Ts&&... ts)
+        {
+            ptr = convert(cb.template emplace<U>(std::forward<Ts>(ts)...));
+        }
+
+        template <typename U, typename A, typename... Ts>
+        void allocate(A const& a, Ts&&... ts)
+        {
+            ptr = convert(cb.template allocate<U>(a, std::forward<Ts>(ts)...));
+        }
+
+        template <typename U, typename... Ts>
+        U& replace(Ts&&... ts)
+        {
+            ptr = nullptr;
+            auto p = cb.template replace<U>(std::forward<Ts>(ts)...);
+            detail::check_allocation(p);
+            ptr = convert(p);
+            return *p;
+        }
+    };
+
+    template <typename U>
+    static T* convert(U* p) noexcept
+    {
+        return const_cast<T*>(static_cast<T const*>(p));
+    }
+
+    template <typename U>
+    static data copy(typename indirect<U, Storage>::data const& other)
+    {
+        data d;
+        d.copy_from(other.cb, other.ptr);
+        return d;
+    }
+
+    template <typename U>
+    static data steal(typename indirect<U, Storage>::data&& other) noexcept
+    {
+        void* from = other.cb.block();
+        data d(std::move(other.cb));
+        d.ptr = d.relocate(other.ptr, from);
+        other.ptr = nullptr;
+        return d;
+    }
+
+    template <typename A>
+    using enable_if_resource_t =
+        std::enable_if_t<!storage_type::always_equal && !std::is_same<std::decay_t<A>, in_place_t>::value, int>;
+
+    data m;
+
+public:
+    template <typename T_ = T, std::enable_if_t<std::is_default_constructible<T_>::value, int> = 0>
+    indirect()
+    {
+        m.template emplace<std::remove_cv_t<T>>();
+    }
+
+    template <typename... Ts>
+    explicit indirect(in_place_t, Ts&&... ts)
+    {
+        m.template emplace<std::remove_cv_t<T>>(std::forward<Ts>(ts)...);
+    }
+
+    template <typename A, typename... Ts>
+    indirect(std::allocator_arg_t, A const& a, in_place_t, Ts&&... ts)
+    {
+        m.template allocate<std::remove_cv_t<T>>(a, std::forward<Ts>(ts)...);
+    }
+
+    indirect(indirect const& other) = default;
+
+    indirect(indirect&& other) noexcept = default;
+
+    indirect& operator=(indirect const& other) = default;
+
+    indirect& operator=(indirect&& other) noexcept(storage_type::always_equal) = default;
+
+    template <typename U, std::enable_if_t<std::is_base_of<T, U>::value, int> = 0>
+    indirect(indirect<U, Storage> const& other) :
+        m(copy<U>(other.m))
+    {
+    }
+
+    template <typename U, std::enable_if_t<std::is_base_of<T, U>::value, int> = 0>
+    indirect(indirect<U, Storage>&& other) noexcept :
+        m(steal<U>(std::move(other.m)))
+    {
+    }
+
+    template <typename U, std::enable_if_t<std::is_base_of<T, U>::value, int> = 0>
+    indirect& operator=(indirect<U, Storage> const& other)
+    {
+        m.assign_from(other.m.cb, other.m.ptr);
+        return *this;
+    }
+
+    template <typename U, std::enable_if_t<std::is_base_of<T, U>::value, int> = 0>
+    indirect& operator=(indirect<U, Storage>&& other) noexcept(storage_type::always_equal)
+    {
+        m = steal<U>(std::move(other.m));
+        return *this;
+    }
+
+    template <typename U, std::enable_if_t<std::is_base_of<T, std::remove_reference_t<U>>::value, int> = 0>
+    indirect(U&& other)
+    {
+        m.template emplace<std::remove_cv_t<std::remove_reference_t<U>>>(std::forward<U>(other));
+    }
+
+    template <typename U, std::enable_if_t<std::is_base_of<T, std::remove_reference_t<U>>::value, int> = 0>
+    indirect& operator=(U&& other)
+    {
+        data d(m.cb.empty_like());
+        d.template emplace<std::remove_cv_t<std::remove_reference_t<U>>>(std::forward<U>(other));
+        m = std::move(d);
+        return *this;
+    }
+
+    // Replaces the object held by a U constructed from `ts...`, without the
+    // temporary and the move of assigning a U. The old object is destroyed
+    // first and its memory reused where the U fits in it; if constructing
+    // the U throws, the `indirect` is left empty.
+    template <typename U, typename... Ts, std::enable_if_t<std::is_base_of<T, U>::value, int> = 0>
+    U& emplace(Ts&&... ts)
+    {
+        return m.template replace<std::remove_cv_t<U>>(std::forward<Ts>(ts)...);
+    }
+
+    // Allocator-extended constructors, available when the storage carries its
+    // own memory resource so that `indirect` can be used in pmr containers.
+    template <typename A, enable_if_resource_t<A> = 0>
+    indirect(std::allocator_arg_t, A const& a, indirect const& other) :
+        m(storage_type(std::allocator_arg, a))
+    {
+        m.copy_from(other.m.cb, other.m.ptr);
+    }
+
+    template <typename A, enable_if_resource_t<A> = 0>
+    indirect(std::allocator_arg_t, A const& a, indirect&& other) :
+        m(storage_type(std::allocator_arg, a))
+    {
+        m = std::move(other.m);
+    }
+
+    template <typename A, typename U, enable_if_resource_t<A> = 0,
+              std::enable_if_t<std::is_base_of<T, std::remove_reference_t<U>>::value, int> = 0>
+    indirect(std::allocator_arg_t, A const& a, U&& other) :
+        m(storage_type(std::allocator_arg, a))
+    {
+        m.template emplace<std::remove_cv_t<std::remove_reference_t<U>>>(std::forward<U>(other));
+    }
+
+    void swap(indirect& other) noexcept(storage_type::always_equal)
+    {
+        if (Storage::size == 0 && storage_type::always_equal)
+        {
+            using std::swap;
+            swap(m.ptr, other.m.ptr);
+            swap(m.cb, other.m.cb);
+        }
+        else
+        {
+            data tmp(std::move(other.m));
+            other.m = std::move(m);
+            m = std::move(tmp);
+        }
+    }
+
+    T const* operator->() const noexcept
+    {
+        return m.ptr;
+    }
+
+    T* operator->() noexcept
+    {
+        return m.ptr;
+    }
+
+    T const& operator*() const noexcept
+    {
+        return *m.ptr;
+    }
+
+    T& operator*() noexcept
+    {
+        return *m.ptr;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return static_cast<bool>(m.cb);
+    }
+
+    // Whether the dynamic type of the object held is exactly U, found by one
+    // comparison rather than by walking the class hierarchy.
+    template <typename U>
+    bool holds_type() const noexcept
+    {
+        return m.cb.holds(&detail::type_token_for<std::remove_cv_t<U>>::value);
+    }
+
+private:
+    template <typename T_, typename U, typename S>
+    friend indirect<T_, S> static_indirect_cast(indirect<U, S> const& i);
+    template <typename T_, typename U, typename S>
+    friend indirect<T_, S> static_indirect_cast(indirect<U, S>&& i) noexcept;
+    template <typename T_, typename U, typename S>
+    friend indirect<T_, S> dynamic_indirect_cast(indirect<U, S> const& i);
+    template <typename T_, typename U, typename S>
+    friend indirect<T_, S> dynamic_indirect_cast(indirect<U, S>&& i);
+    template <typename T_, typename U, typename S>
+    friend indirect<T_, S> exact_indirect_cast(indirect<U, S> const& i);
+    template <typename T_, typename U, typename S>
+    friend indirect<T_, S> exact_indirect_cast(indirect<U, S>&& i);
+    template <typename T_, typename... Ts>
+    friend indirect<T_> try_make_indirect(Ts&&... ts);
+    template <typename T_, typename S>
+    friend indirect<T_, S> try_copy(indirect<T_, S> const& i);
+    template <typename T_, typename U, typename S>
+    friend indirect<T_, S> try_dynamic_indirect_cast(indirect<U, S> const& i);
+    template <typename T_, typename U, typename S>
+    friend indirect<T_, S> try_dynamic_indirect_cast(indirect<U, S>&& i);
+
+    template <typename U>
+    static indirect copied_from(indirect<U, Storage> const& i, T const* p)
+    {
+        indirect r{empty_tag{}};
+        r.m.copy_from(i.m.cb, p);
+        return r;
+    }
+
+    // Takes over the block of `i`, whose object `p` points into, without
+    // allocating; only a block stored inline is moved.
+    template <typename U>
+    static indirect moved_from(indirect<U, Storage>& i, T const* p) noexcept
+    {
+        void* from = i.m.cb.block();
+        indirect r{std::move(i.m.cb)};
+        r.m.ptr = r.m.relocate(p, from);
+        i.m.ptr = nullptr;
+        return r;
+    }
+
+    // Without exceptions an allocation that fails leaves the result empty;
+    // with them, running out of memory is caught here to do the same.
+    template <typename U>
+    static indirect try_copied_from(indirect<U, Storage> const& i, T const* p)
+    {
+        indirect r{empty_tag{}};
+        INDIRECT_TRY
+        {
+            r.m.try_copy_from(i.m.cb, p);
+        }
+        INDIRECT_CATCH_BAD_ALLOC
+        {
+        }
+        return r;
+    }
+
+    template <typename... Ts>
+    static indirect try_emplaced(Ts&&... ts)
+    {
+        indirect r{empty_tag{}};
+        INDIRECT_TRY
+        {
+            r.m.template try_emplace<std::remove_cv_t<T>>(std::forward<Ts>(ts)...);
+        }
+        INDIRECT_CATCH_BAD_ALLOC
+        {
+        }
+        return r;
+    }
+
+    struct empty_tag
+    {
+    };
+
+    explicit indirect(empty_tag) noexcept
+    {
+    }
+
+    explicit indirect(storage_type&& cb) noexcept :
+        m(std::move(cb))
+    {
+    }
+
+    template <typename U>
+    U const* unchecked_static_cast() const
+    {
+        return static_cast<U const*>(m.ptr);
+    }
+
+    template <typename U>
+    U const* checked_dynamic_cast() const
+    {
+        auto p = dynamic_cast<U const*>(m.ptr);
+        if (!p)
+        {
+            detail::throw_bad_indirect_cast();
+        }
+        return p;
+    }
+
+    template <typename U>
+    U const* checked_exact_cast() const
+    {
+        if (!holds_type<U>())
+        {
+            detail::throw_bad_indirect_cast();
+        }
+        return detail::exact_downcast<U>(m.ptr, 0);
+    }
+};
 
-struct in_place_t
+namespace detail
 {
-};
 
-constexpr in_place_t in_place;
+    template <typename... Ts>
+    struct starts_with_call_site : std::false_type
+    {
+    };
 
-class bad_indirect_cast : public std::bad_cast
+    template <typename T, typename... Ts>
+    struct starts_with_call_site<T, Ts...> : std::is_same<std::decay_t<T>, indirect_call_site>
+    {
+    };
+
+} // namespace detail
+
+template <typename T, typename... Ts, std::enable_if_t<!detail::starts_with_call_site<Ts...>::value, int> = 0>
+indirect<T> make_indirect(Ts&&... ts)
 {
-};
+    return indirect<T>(in_place, std::forward<Ts>(ts)...);
+}
 
-namespace detail
+template <typename T, typename A, typename... Ts>
+indirect<T> allocate_indirect(A const& a, Ts&&... ts)
+{
+    return indirect<T>(std::allocator_arg, a, in_place, std::forward<Ts>(ts)...);
+}
+
+template <typename T, typename U, typename S>
+indirect<T, S> static_indirect_cast(indirect<U, S> const& i)
+{
+    return indirect<T, S>::copied_from(i, i.template unchecked_static_cast<T>());
+}
+
+template <typename T, typename U, typename S>
+indirect<T, S> static_indirect_cast(indirect<U, S>&& i) noexcept
+{
+    return indirect<T, S>::moved_from(i, i.template unchecked_static_cast<T>());
+}
+
+template <typename T, typename U, typename S>
+indirect<T, S> dynamic_indirect_cast(indirect<U, S> const& i)
+{
+    return indirect<T, S>::copied_from(i, i.template checked_dynamic_cast<T>());
+}
+
+template <typename T, typename U, typename S>
+indirect<T, S> dynamic_indirect_cast(indirect<U, S>&& i)
+{
+    return indirect<T, S>::moved_from(i, i.template checked_dynamic_cast<T>());
+}
+
+// Casts to the exact dynamic type of the object, throwing `bad_indirect_cast`
+// for any other type, including bases of it.
+template <typename T, typename U, typename S>
+indirect<T, S> exact_indirect_cast(indirect<U, S> const& i)
+{
+    return indirect<T, S>::copied_from(i, i.template checked_exact_cast<T>());
+}
+
+template <typename T, typename U, typename S>
+indirect<T, S> exact_indirect_cast(indirect<U, S>&& i)
+{
+    return indirect<T, S>::moved_from(i, i.template checked_exact_cast<T>());
+}
+
+// The `try_` functions leave their result empty instead of throwing
+// `std::bad_alloc` or `bad_indirect_cast`, or terminating without exceptions.
+// Exceptions thrown by the object's own constructors still propagate.
+template <typename T, typename... Ts>
+indirect<T> try_make_indirect(Ts&&... ts)
+{
+    return indirect<T>::try_emplaced(std::forward<Ts>(ts)...);
+}
+
+template <typename T, typename S>
+indirect<T, S> try_copy(indirect<T, S> const& i)
+{
+    return indirect<T, S>::try_copied_from(i, i.m.ptr);
+}
+
+template <typename T, typename U, typename S>
+indirect<T, S> try_dynamic_indirect_cast(indirect<U, S> const& i)
+{
+    auto p = dynamic_cast<T const*>(i.m.ptr);
+    return p ? indirect<T, S>::try_copied_from(i, p) : indirect<T, S>{typename indirect<T, S>::empty_tag{}};
+}
+
+template <typename T, typename U, typename S>
+indirect<T, S> try_dynamic_indirect_cast(indirect<U, S>&& i)
+{
+    auto p = dynamic_cast<T const*>(i.m.ptr);
+    return p ? indirect<T, S>::moved_from(i, p) : indirect<T, S>{typename indirect<T, S>::empty_tag{}};
+}
+
+// A non-owning view of the object of an `indirect`, or of another handle, as
+// a `T const`, made without copying the object. It is invalidated by anything
+// that destroys or moves the handle's object.
+template <typename T>
+class indirect_cast_view
 {
+private:
+    T const* ptr = nullptr;
+
+public:
+    indirect_cast_view() = default;
 
-    class control_block
+    explicit indirect_cast_view(T const* p) noexcept :
+        ptr(p)
     {
-    public:
-        virtual ~control_block() = default;
-        virtual std::unique_ptr<control_block> copy() const = 0;
-        virtual std::unique_ptr<control_block> move() = 0;
-        virtual void* ptr() = 0;
-    };
+    }
 
-    template <typename T>
-    class direct_control_block final : public control_block
+    T const* get() const noexcept
     {
-    private:
-        T t;
+        return ptr;
+    }
 
-    public:
-        template <typename... Ts>
-        explicit direct_control_block(Ts&&... ts) :
-            t(std::forward<Ts>(ts)...)
+    T const* operator->() const noexcept
+    {
+        return ptr;
+    }
+
+    T const& operator*() const noexcept
+    {
+        return *ptr;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return ptr != nullptr;
+    }
+};
+
+// The view of an empty handle is empty, as is a dynamic view of an object
+// that is not a T.
+template <typename T, typename I>
+indirect_cast_view<T> static_indirect_cast_view(I const& i) noexcept
+{
+    return indirect_cast_view<T>(static_cast<T const*>(i.operator->()));
+}
+
+template <typename T, typename I>
+indirect_cast_view<T> dynamic_indirect_cast_view(I const& i) noexcept
+{
+    return indirect_cast_view<T>(dynamic_cast<T const*>(i.operator->()));
+}
+
+template <typename T, typename U, typename S>
+indirect_cast_view<T> exact_indirect_cast_view(indirect<U, S> const& i) noexcept
+{
+    return indirect_cast_view<T>(i.template holds_type<T>() ? detail::exact_downcast<T>(&*i, 0) : nullptr);
+}
+
+template <typename T, typename I>
+void static_indirect_cast_view(I const&&) = delete;
+
+template <typename T, typename I>
+void dynamic_indirect_cast_view(I const&&) = delete;
+
+template <typename T, typename U, typename S>
+void exact_indirect_cast_view(indirect<U, S> const&&) = delete;
+
+template <typename T, typename S>
+void swap(indirect<T, S>& i1, indirect<T, S>& i2) noexcept(noexcept(i1.swap(i2)))
+{
+    i1.swap(i2);
+}
+
+namespace detail
+{
+
+    // Builds `indirect`s from parts for the containers and algorithms
+    // layered on top of it.
+    struct indirect_access
+    {
+        template <typename T, typename U>
+        static indirect<T> adopt(control_block* b, U* p) noexcept
         {
+            indirect<T> i{typename indirect<T>::empty_tag{}};
+            i.m.cb.adopt(b);
+            i.m.ptr = indirect<T>::convert(p);
+            return i;
         }
 
-        std::unique_ptr<control_block> copy() const override
+        // An `indirect` holding nothing, only fit to be assigned to.
+        template <typename T, typename S>
+        static indirect<T, S> empty() noexcept
         {
-            return std::make_unique<direct_control_block>(t);
+            return indirect<T, S>{typename indirect<T, S>::empty_tag{}};
         }
 
-        std::unique_ptr<control_block> move() override
+        // The dynamic type of the object held by `i`, null if it holds none.
+        template <typename T, typename S>
+        static type_token type(indirect<T, S> const& i) noexcept
         {
-            return std::make_unique<direct_control_block>(std::move(t));
+            return i.m.cb.type();
         }
 
-        void* ptr() override
+        template <typename T, typename S>
+        static void trace(indirect<T, S>& i, indirect_call_site const& site) noexcept
         {
-            return &t;
+#ifdef INDIRECT_INSTRUMENTATION
+            if (auto b = static_cast<control_block*>(i.m.cb.block()))
+            {
+                b->site = &site;
+                site.record(block_event::construct);
+            }
+#else
+            (void)i;
+            (void)site;
+#endif
         }
     };
 
+} // namespace detail
+
+// Makes an `indirect<T>` as `make_indirect<T>(ts...)` does whose block, and
+// every copy of it, is counted against `site` when instrumented, as in
+// `make_indirect<T>(INDIRECT_CALL_SITE, ts...)`.
+template <typename T, typename... Ts>
+indirect<T> make_indirect(indirect_call_site const& site, Ts&&... ts)
+{
+    indirect<T> i(in_place, std::forward<Ts>(ts)...);
+    detail::indirect_access::trace(i, site);
+    return i;
+}
+
+namespace detail
+{
+
+    // Names the allocations of `indirect<T, exact_type>` for instrumentation.
     template <typename T>
-    using dcb_t = direct_control_block<std::remove_cv_t<std::remove_reference_t<T>>>;
+    struct exact_block
+    {
+        using value_type = T;
+
+        static constexpr char const* kind = "exact";
+    };
 
 } // namespace detail
 
 template <typename T>
-class indirect
+class indirect<T, exact_type>
 {
-    template <typename>
-    friend class indirect;
-
 private:
-    struct data
+    using block = detail::exact_block<std::remove_cv_t<T>>;
+
+    T* ptr = nullptr;
+
+    template <typename... Ts>
+    static T* create(Ts&&... ts)
     {
-        T* ptr;
-        std::unique_ptr<detail::control_block> cb;
+        auto p = try_create(std::forward<Ts>(ts)...);
+        detail::check_allocation(p);
+        return p;
+    }
 
-        data(std::unique_ptr<detail::control_block>&& cb_) :
-            ptr(static_cast<T*>(cb_->ptr())),
-            cb(std::move(cb_))
+    template <typename... Ts>
+    static T* try_create(Ts&&... ts)
+    {
+#ifdef INDIRECT_HAS_EXCEPTIONS
+        auto p = new std::remove_cv_t<T>(std::forward<Ts>(ts)...);
+#else
+        auto p = new (std::nothrow) std::remove_cv_t<T>(std::forward<Ts>(ts)...);
+        if (!p)
         {
+            return nullptr;
         }
+#endif
+        detail::record_allocation<block>(sizeof(T));
+        return p;
+    }
 
-        data& operator=(std::unique_ptr<detail::control_block>&& cb_)
+    void reset() noexcept
+    {
+        if (ptr)
         {
-            ptr = static_cast<T*>(cb_->ptr());
-            cb = std::move(cb_);
-            return *this;
+            detail::record<block>(detail::block_event::destroy);
+            delete ptr;
+            detail::record_deallocation<block>(sizeof(T));
+            ptr = nullptr;
         }
-    };
-
-    data m;
+    }
 
 public:
     template <typename T_ = T, std::enable_if_t<std::is_default_constructible<T_>::value, int> = 0>
     indirect() :
-        m(std::make_unique<detail::dcb_t<T>>())
+        ptr(create())
     {
+        detail::record<block>(detail::block_event::construct);
     }
 
     template <typename... Ts>
     explicit indirect(in_place_t, Ts&&... ts) :
-        m(std::make_unique<detail::dcb_t<T>>(std::forward<Ts>(ts)...))
-    {
-    }
-
-    indirect(indirect const& other) :
-        m(other.m.cb->copy())
+        ptr(create(std::forward<Ts>(ts)...))
     {
+        detail::record<block>(detail::block_event::construct);
     }
 
-    indirect(indirect&& other) :
-        m(other.m.cb->move())
+    indirect(T const& t) :
+        ptr(create(t))
     {
+        detail::record<block>(detail::block_event::construct);
     }
 
-    indirect& operator=(indirect const& other)
+    indirect(T&& t) :
+        ptr(create(std::move(t)))
     {
-        m = other.m.cb->copy();
-        return *this;
+        detail::record<block>(detail::block_event::construct);
     }
 
-    indirect& operator=(indirect&& other)
-    {
-        m = other.m.cb->move();
-        return *this;
-    }
+    // An object of a class derived from `T` would be sliced.
+    template <typename U,
+              std::enable_if_t<std::is_base_of<T, std::decay_t<U>>::value &&
+                                   !std::is_same<std::remove_cv_t<T>, std::decay_t<U>>::value,
+                               int> = 0>
+    indirect(U&&) = delete;
 
-    template <typename U, std::enable_if_t<std::is_base_of<T, U>::value, int> = 0>
-    indirect(indirect<U> const& other) :
-        m(other.m.cb->copy())
+    indirect(indirect const& other) :
+        ptr(other.ptr ? create(*other.ptr) : nullptr)
     {
+        if (ptr)
+        {
+            detail::record<block>(detail::block_event::copy);
+        }
     }
 
-    template <typename U, std::enable_if_t<std::is_base_of<T, U>::value, int> = 0>
-    indirect(indirect<U>&& other) :
-        m(other.m.cb->move())
+    indirect(indirect&& other) noexcept :
+        ptr(other.ptr)
     {
+        other.ptr = nullptr;
     }
 
-    template <typename U, std::enable_if_t<std::is_base_of<T, U>::value, int> = 0>
-    indirect& operator=(indirect<U> const& other)
+    ~indirect()
     {
-        m = other.m.cb->copy();
-        return *this;
+        reset();
     }
 
-    template <typename U, std::enable_if_t<std::is_base_of<T, U>::value, int> = 0>
-    indirect& operator=(indirect<U>&& other)
+    indirect& operator=(indirect const& other)
     {
-        m = other.m.cb->move();
+        if (this != &other)
+        {
+            assign(other, std::is_nothrow_copy_assignable<T>());
+        }
         return *this;
     }
 
-    template <typename U, std::enable_if_t<std::is_base_of<T, std::remove_reference_t<U>>::value, int> = 0>
-    indirect(U&& other) :
-        m(std::make_unique<detail::dcb_t<U>>(std::forward<U>(other)))
-    {
-    }
-
-    template <typename U, std::enable_if_t<std::is_base_of<T, std::remove_reference_t<U>>::value, int> = 0>
-    indirect& operator=(U&& other)
+    indirect& operator=(indirect&& other) noexcept
     {
-        m = std::make_unique<detail::dcb_t<U>>(std::forward<U>(other));
+        if (this != &other)
+        {
+            reset();
+            ptr = other.ptr;
+            other.ptr = nullptr;
+        }
         return *this;
     }
 
     void swap(indirect& other) noexcept
     {
         using std::swap;
-        swap(m.ptr, other.m.ptr);
-        swap(m.cb, other.m.cb);
+        swap(ptr, other.ptr);
     }
 
     T const* operator->() const noexcept
     {
-        return m.ptr;
+        return ptr;
     }
 
     T* operator->() noexcept
     {
-        return m.ptr;
+        return ptr;
     }
 
     T const& operator*() const noexcept
     {
-        return *m.ptr;
+        return *ptr;
     }
 
     T& operator*() noexcept
     {
-        return *m.ptr;
+        return *ptr;
     }
 
-private:
-    template <typename T, typename U>
-    friend indirect<T> static_indirect_cast(indirect<U> const& i);
-    template <typename T, typename U>
-    friend indirect<T> static_indirect_cast(indirect<U>&& i);
-    template <typename T, typename U>
-    friend indirect<T> dynamic_indirect_cast(indirect<U> const& i);
-    template <typename T, typename U>
-    friend indirect<T> dynamic_indirect_cast(indirect<U>&& i);
-
-    explicit indirect(std::unique_ptr<detail::control_block>&& cb) noexcept :
-        m(std::move(cb))
+    explicit operator bool() const noexcept
     {
+        return ptr != nullptr;
     }
 
     template <typename U>
-    void try_static_cast() const
+    bool holds_type() const noexcept
     {
-        static_cast<U*>(m.ptr);
+        return ptr && std::is_same<std::remove_cv_t<U>, std::remove_cv_t<T>>::value;
     }
 
-    template <typename U>
-    void try_dynamic_cast() const
+private:
+    template <typename T_>
+    friend indirect<T_, exact_type> try_copy(indirect<T_, exact_type> const& i);
+
+    void assign(indirect const& other, std::true_type)
     {
-        if (!dynamic_cast<U*>(m.ptr))
+        if (ptr && other.ptr)
         {
-            throw bad_indirect_cast();
+            *ptr = *other.ptr;
+            detail::record<block>(detail::block_event::assign);
+            return;
         }
+        assign(other, std::false_type());
+    }
+
+    void assign(indirect const& other, std::false_type)
+    {
+        indirect tmp(other);
+        swap(tmp);
+    }
+
+    struct empty_tag
+    {
+    };
+
+    explicit indirect(empty_tag) noexcept
+    {
     }
 };
 
-template <typename T, typename... Ts>
-indirect<T> make_indirect(Ts&&... ts)
+template <typename T>
+indirect<T, exact_type> try_copy(indirect<T, exact_type> const& i)
 {
-    return indirect<T>(in_place, std::forward<Ts>(ts)...);
+    indirect<T, exact_type> r{typename indirect<T, exact_type>::empty_tag{}};
+    if (i.ptr)
+    {
+        INDIRECT_TRY
+        {
+            r.ptr = indirect<T, exact_type>::try_create(*i.ptr);
+        }
+        INDIRECT_CATCH_BAD_ALLOC
+        {
+        }
+        if (r.ptr)
+        {
+            detail::record<typename indirect<T, exact_type>::block>(detail::block_event::copy);
+        }
+    }
+    return r;
+}
+
+// Comparisons forward to the objects held, whatever the storage; as with
+// `std::optional`, an empty `indirect` equals only another empty one and
+// orders before any object.
+template <typename T, typename S, typename U, typename S2>
+auto operator==(indirect<T, S> const& a, indirect<U, S2> const& b) -> decltype(static_cast<bool>(*a == *b))
+{
+    if (!a || !b)
+    {
+        return !a && !b;
+    }
+    return *a == *b;
+}
+
+template <typename T, typename S, typename U, typename S2>
+auto operator!=(indirect<T, S> const& a, indirect<U, S2> const& b) -> decltype(static_cast<bool>(*a != *b))
+{
+    if (!a || !b)
+    {
+        return !a != !b;
+    }
+    return *a != *b;
 }
 
-template <typename T, typename U>
-indirect<T> static_indirect_cast(indirect<U> const& i)
+template <typename T, typename S, typename U, typename S2>
+auto operator<(indirect<T, S> const& a, indirect<U, S2> const& b) -> decltype(static_cast<bool>(*a < *b))
 {
-    i.try_static_cast<T>();
-    return indirect<T>(i.m.cb->copy());
+    if (!a || !b)
+    {
+        return !a && b;
+    }
+    return *a < *b;
 }
 
-template <typename T, typename U>
-indirect<T> static_indirect_cast(indirect<U>&& i)
+template <typename T, typename S, typename U, typename S2>
+auto operator<=(indirect<T, S> const& a, indirect<U, S2> const& b) -> decltype(static_cast<bool>(*a <= *b))
 {
-    i.try_static_cast<T>();
-    return indirect<T>(i.m.cb->move());
+    if (!a || !b)
+    {
+        return !a;
+    }
+    return *a <= *b;
 }
 
-template <typename T, typename U>
-indirect<T> dynamic_indirect_cast(indirect<U> const& i)
+template <typename T, typename S, typename U, typename S2>
+auto operator>(indirect<T, S> const& a, indirect<U, S2> const& b) -> decltype(static_cast<bool>(*a > *b))
 {
-    i.try_dynamic_cast<T>();
-    return indirect<T>(i.m.cb->copy());
+    if (!a || !b)
+    {
+        return a && !b;
+    }
+    return *a > *b;
 }
 
-template <typename T, typename U>
-indirect<T> dynamic_indirect_cast(indirect<U>&& i)
+template <typename T, typename S, typename U, typename S2>
+auto operator>=(indirect<T, S> const& a, indirect<U, S2> const& b) -> decltype(static_cast<bool>(*a >= *b))
 {
-    i.try_dynamic_cast<T>();
-    return indirect<T>(i.m.cb->move());
+    if (!a || !b)
+    {
+        return !b;
+    }
+    return *a >= *b;
 }
 
+// Whether an object of type T can be relocated (moved to new storage and its
+// source destroyed) by copying its bytes. Specialize for types that only hold
+// pointers to memory they own. An `indirect` other than one with an inline
+// buffer is such a type: its object pointer never points into itself.
 template <typename T>
-void swap(indirect<T>& i1, indirect<T>& i2) noexcept
+struct is_trivially_relocatable : std::is_trivially_copyable<T>
 {
-    i1.swap(i2);
+};
+
+template <typename T, typename Storage>
+struct is_trivially_relocatable<indirect<T, Storage>> : std::integral_constant<bool, Storage::size == 0>
+{
+};
+
+template <typename T>
+struct is_trivially_relocatable<indirect<T, exact_type>> : std::true_type
+{
+};
+
+namespace detail
+{
+
+    template <typename T>
+    void relocate_n(T* first, std::size_t n, T* d_first, std::true_type) noexcept
+    {
+        std::memmove(static_cast<void*>(d_first), static_cast<void const*>(first), n * sizeof(T));
+    }
+
+    template <typename T>
+    void relocate_n(T* first, std::size_t n, T* d_first, std::false_type) noexcept
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            ::new (static_cast<void*>(d_first + i)) T(std::move(first[i]));
+            first[i].~T();
+        }
+    }
+
+} // namespace detail
+
+// Relocates `*source` into the uninitialized storage at `dest`, after which
+// `source` is uninitialized storage.
+template <typename T>
+T* relocate_at(T* source, T* dest) noexcept
+{
+    static_assert(is_trivially_relocatable<T>::value || std::is_nothrow_move_constructible<T>::value,
+                  "relocation must not throw");
+    detail::relocate_n(source, 1, dest, is_trivially_relocatable<T>());
+    return dest;
+}
+
+// Relocates [first, last) into the uninitialized storage starting at
+// `d_first`. The ranges may overlap if `d_first` is not after `first`, as when
+// closing the gap left by erasing from an array.
+template <typename T>
+T* uninitialized_relocate(T* first, T* last, T* d_first) noexcept
+{
+    static_assert(is_trivially_relocatable<T>::value || std::is_nothrow_move_constructible<T>::value,
+                  "relocation must not throw");
+    auto n = static_cast<std::size_t>(last - first);
+    detail::relocate_n(first, n, d_first, is_trivially_relocatable<T>());
+    return d_first + n;
 }
+
+namespace std
+{
+
+    // Hashes the object held with `std::hash<T>`, so that equal `indirect`s
+    // hash alike; an empty `indirect` hashes to 0.
+    template <typename T, typename S>
+    struct hash<::indirect<T, S>>
+    {
+        std::size_t operator()(::indirect<T, S> const& i) const
+        {
+            return i ? hash<remove_cv_t<T>>()(*i) : 0;
+        }
+    };
+
+} // namespace std
+
+#ifdef INDIRECT_HAS_PMR
+namespace std
+{
+
+    template <typename T, typename S, typename A>
+    struct uses_allocator<::indirect<T, ::pmr::resource_storage<S>>, A>
+        : is_convertible<A, pmr::polymorphic_allocator<byte>>
+    {
+    };
+
+} // namespace std
+#endif
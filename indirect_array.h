@@ -0,0 +1,145 @@
+#pragma once
+
+#include <indirect.h>
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace detail
+{
+
+    // The start of one allocation holding the control blocks of a whole
+    // `make_indirect_array`, freed when the last of them is destroyed.
+    struct slab_header
+    {
+        std::atomic<std::size_t> live;
+        std::size_t size;
+        std::size_t align;
+
+        static slab_header* create(std::size_t size, std::size_t align, std::size_t count)
+        {
+            return ::new (allocate_bytes(size, align)) slab_header{{count}, size, align};
+        }
+
+        void release(std::size_t count = 1) noexcept
+        {
+            if (live.fetch_sub(count, std::memory_order_acq_rel) == count)
+            {
+                auto size_ = size;
+                auto align_ = align;
+                this->~slab_header();
+                deallocate_bytes(this, size_, align_);
+            }
+        }
+    };
+
+    // A block in a slab. Copies and moves of its object go into ordinary
+    // direct blocks, which hold it at the same offset from the block.
+    template <typename T>
+    class slab_control_block final : public control_block
+    {
+        template <typename>
+        friend struct vtable_for;
+
+    private:
+        T t;
+        slab_header* slab;
+
+        direct_control_block<T>* clone(void* buffer) const
+        {
+            return direct_control_block<T>::create(buffer, t);
+        }
+
+        direct_control_block<T>* relocate(void* buffer)
+        {
+            return direct_control_block<T>::create(buffer, std::move(t));
+        }
+
+        void dispose() noexcept
+        {
+            auto s = slab;
+            this->~slab_control_block();
+            s->release();
+            record_deallocation<slab_control_block>(sizeof(slab_control_block));
+        }
+
+    public:
+        using value_type = T;
+
+        static constexpr char const* kind = "slab";
+        static constexpr bool nothrow_move = std::is_nothrow_move_constructible<T>::value;
+
+        template <typename... Ts>
+        explicit slab_control_block(slab_header* s, Ts&&... ts) :
+            control_block{&vtable_for<slab_control_block>::value},
+            t(std::forward<Ts>(ts)...),
+            slab(s)
+        {
+        }
+
+        T* get() noexcept
+        {
+            return &t;
+        }
+    };
+
+    // Appends `n` elements to `v` whose blocks, each created by
+    // `construct(where, slab)`, share one allocation. A block that throws
+    // leaves the elements appended before it in `v`.
+    template <typename T, typename U, typename F>
+    void append_slab(std::vector<indirect<T>>& v, std::size_t n, F construct)
+    {
+        using block = slab_control_block<U>;
+        constexpr std::size_t offset = (sizeof(slab_header) + alignof(block) - 1) / alignof(block) * alignof(block);
+
+        if (n == 0)
+        {
+            return;
+        }
+        v.reserve(v.size() + n);
+
+        // One reference per element, plus one that keeps the slab alive while
+        // the elements are constructed and is dropped with those never made.
+        auto slab = slab_header::create(offset + n * sizeof(block), alignof(block), n + 1);
+        struct reference
+        {
+            slab_header* slab;
+            std::size_t unused;
+
+            ~reference()
+            {
+                slab->release(unused + 1);
+            }
+        } hold{slab, n};
+
+        auto first = reinterpret_cast<char*>(slab) + offset;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            block* b = construct(static_cast<void*>(first + i * sizeof(block)), slab);
+            --hold.unused;
+            record_allocation<block>(sizeof(block));
+            record<block>(block_event::construct);
+            v.push_back(indirect_access::adopt<T>(b, b->get()));
+        }
+    }
+
+} // namespace detail
+
+// Creates `n` `indirect<T>`s, each holding a `T` constructed from `ts...`,
+// whose control blocks share one contiguous allocation. Each element keeps
+// value semantics: a copy of an element is allocated on its own, and the
+// allocation is released once every element is destroyed, wherever the
+// elements have been moved to.
+template <typename T, typename... Ts>
+std::vector<indirect<T>> make_indirect_array(std::size_t n, Ts const&... ts)
+{
+    using block = detail::slab_control_block<std::remove_cv_t<T>>;
+
+    std::vector<indirect<T>> v;
+    detail::append_slab<T, std::remove_cv_t<T>>(
+        v, n, [&](void* where, detail::slab_header* slab) { return ::new (where) block(slab, ts...); });
+    return v;
+}
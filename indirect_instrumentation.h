@@ -0,0 +1,521 @@
+#pragma once
+
+#include <cstddef>
+
+// Opt-in counters for the control blocks created by `indirect` and
+// `compact_indirect`. Define INDIRECT_INSTRUMENTATION in every translation
+// unit of a program to enable them; otherwise every hook is an empty inline
+// function and `indirect_call_site` an empty tag.
+//
+// Counters are sharded by thread, so that threads creating and copying
+// blocks of one type do not contend for a cache line. Blocks can also be
+// traced to the call site that made them: `make_indirect<T>(INDIRECT_CALL_SITE,
+// ts...)` counts the object made and every copy, move and destruction of it
+// and of its copies against that line.
+
+#ifdef INDIRECT_INSTRUMENTATION
+#include <atomic>
+#include <typeinfo>
+#include <vector>
+
+#if defined(__has_include)
+#if __has_include(<unistd.h>)
+#include <unistd.h>
+#define INDIRECT_HAS_UNISTD 1
+#endif
+#endif
+#endif
+
+namespace detail
+{
+
+    // An `assign` copies over an object in place, without a new block.
+    enum class block_event
+    {
+        construct,
+        copy,
+        move,
+        destroy,
+        assign
+    };
+
+    // Receives each line of `indirect_instrumentation_dump`.
+    using dump_writer = void (*)(char const* data, std::size_t size, void* context);
+
+} // namespace detail
+
+#ifdef INDIRECT_INSTRUMENTATION
+
+// `live` counts the blocks not yet destroyed. `peak_bytes` is an upper bound
+// on the most bytes allocated and not released at once, and exact only when
+// a single thread allocates blocks of the type: it is the sum over the
+// counter shards of the most bytes each held, so threads that peak at
+// different times add up to more than was ever held.
+struct indirect_block_stats
+{
+    std::type_info const* type;
+    char const* block;
+    std::size_t constructions;
+    std::size_t copies;
+    std::size_t moves;
+    std::size_t destroys;
+    std::size_t allocations;
+    std::size_t deallocations;
+    std::size_t allocated_bytes;
+    std::size_t deallocated_bytes;
+    std::size_t live;
+    std::size_t peak_bytes;
+};
+
+struct indirect_site_stats
+{
+    char const* file;
+    int line;
+    char const* function;
+    std::size_t constructions;
+    std::size_t copies;
+    std::size_t moves;
+    std::size_t destroys;
+    std::size_t live;
+};
+
+namespace detail
+{
+
+    constexpr std::size_t counter_shards = 16;
+
+    // Threads are given shards in turn as they first count something.
+    inline std::size_t shard_index() noexcept
+    {
+        static std::atomic<std::size_t> next{0};
+        thread_local std::size_t index = next.fetch_add(1, std::memory_order_relaxed) % counter_shards;
+        return index;
+    }
+
+    // N counters per shard, each shard on cache lines of its own. Adding is a
+    // relaxed increment of the calling thread's shard; a sum is exact only
+    // once no thread is adding.
+    template <std::size_t N>
+    class sharded_counters
+    {
+    private:
+        struct alignas(64) shard
+        {
+            std::atomic<std::size_t> n[N] = {};
+        };
+
+        shard shards[counter_shards];
+
+    public:
+        std::atomic<std::size_t>* local() noexcept
+        {
+            return shards[shard_index()].n;
+        }
+
+        void add(std::size_t i, std::size_t v) noexcept
+        {
+            local()[i].fetch_add(v, std::memory_order_relaxed);
+        }
+
+        std::size_t sum(std::size_t i) const noexcept
+        {
+            std::size_t s = 0;
+            for (auto const& sh : shards)
+            {
+                s += sh.n[i].load(std::memory_order_relaxed);
+            }
+            return s;
+        }
+
+        void reset() noexcept
+        {
+            for (auto& sh : shards)
+            {
+                for (auto& c : sh.n)
+                {
+                    c.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+    };
+
+    // The first counters of each are those of the `block_event`s.
+    enum block_counter : std::size_t
+    {
+        allocations_counter = 5,
+        deallocations_counter,
+        allocated_bytes_counter,
+        deallocated_bytes_counter,
+        peak_bytes_counter,
+        block_counter_count
+    };
+
+    inline std::size_t live_count(std::size_t construct, std::size_t copy, std::size_t move,
+                                  std::size_t destroy) noexcept
+    {
+        return construct + copy + move - destroy;
+    }
+
+    // One per control block type, registered in a lock-free list on first use.
+    class block_counters
+    {
+    public:
+        std::type_info const& type;
+        char const* const block;
+        sharded_counters<block_counter_count> counters;
+        block_counters* next = nullptr;
+
+        block_counters(std::type_info const& type_, char const* block_) noexcept :
+            type(type_),
+            block(block_)
+        {
+            auto& list = head();
+            next = list.load(std::memory_order_relaxed);
+            while (!list.compare_exchange_weak(next, this, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        static std::atomic<block_counters*>& head() noexcept
+        {
+            static std::atomic<block_counters*> list{nullptr};
+            return list;
+        }
+
+        std::size_t count(block_event e) const noexcept
+        {
+            return counters.sum(static_cast<std::size_t>(e));
+        }
+
+        void allocate(std::size_t bytes) noexcept
+        {
+            auto shard = counters.local();
+            shard[allocations_counter].fetch_add(1, std::memory_order_relaxed);
+            auto allocated = shard[allocated_bytes_counter].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+            auto held = allocated - shard[deallocated_bytes_counter].load(std::memory_order_relaxed);
+            auto peak = shard[peak_bytes_counter].load(std::memory_order_relaxed);
+            // A shard whose blocks were released by other threads holds less
+            // than nothing, which is no peak.
+            while (static_cast<std::ptrdiff_t>(held) > static_cast<std::ptrdiff_t>(peak) &&
+                   !shard[peak_bytes_counter].compare_exchange_weak(peak, held, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        void deallocate(std::size_t bytes) noexcept
+        {
+            auto shard = counters.local();
+            shard[deallocations_counter].fetch_add(1, std::memory_order_relaxed);
+            shard[deallocated_bytes_counter].fetch_add(bytes, std::memory_order_relaxed);
+        }
+
+        indirect_block_stats snapshot() const noexcept
+        {
+            auto constructions = count(block_event::construct);
+            auto copies = count(block_event::copy);
+            auto moves = count(block_event::move);
+            auto destroys = count(block_event::destroy);
+            return {&type,
+                    block,
+                    constructions,
+                    copies + count(block_event::assign),
+                    moves,
+                    destroys,
+                    counters.sum(allocations_counter),
+                    counters.sum(deallocations_counter),
+                    counters.sum(allocated_bytes_counter),
+                    counters.sum(deallocated_bytes_counter),
+                    live_count(constructions, copies, moves, destroys),
+                    counters.sum(peak_bytes_counter)};
+        }
+
+        void reset() noexcept
+        {
+            counters.reset();
+        }
+    };
+
+    template <typename Block>
+    block_counters& counters_for() noexcept
+    {
+        static block_counters counters(typeid(typename Block::value_type), Block::kind);
+        return counters;
+    }
+
+    template <typename Block>
+    void record(block_event e) noexcept
+    {
+        counters_for<Block>().counters.add(static_cast<std::size_t>(e), 1);
+    }
+
+    template <typename Block>
+    void record_allocation(std::size_t bytes) noexcept
+    {
+        counters_for<Block>().allocate(bytes);
+    }
+
+    template <typename Block>
+    void record_deallocation(std::size_t bytes) noexcept
+    {
+        counters_for<Block>().deallocate(bytes);
+    }
+
+} // namespace detail
+
+// A place in the source that makes `indirect`s, whose blocks and their copies
+// are counted against it. Declare one with static storage duration, as
+// INDIRECT_CALL_SITE does, since the blocks refer to it.
+class indirect_call_site
+{
+public:
+    char const* const file;
+    int const line;
+    char const* const function;
+
+    indirect_call_site(char const* file_, int line_, char const* function_) noexcept :
+        file(file_),
+        line(line_),
+        function(function_)
+    {
+        auto& list = head();
+        next = list.load(std::memory_order_relaxed);
+        while (!list.compare_exchange_weak(next, this, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    indirect_call_site(indirect_call_site const&) = delete;
+    indirect_call_site& operator=(indirect_call_site const&) = delete;
+
+    static std::atomic<indirect_call_site*>& head() noexcept
+    {
+        static std::atomic<indirect_call_site*> list{nullptr};
+        return list;
+    }
+
+    indirect_call_site* next_site() const noexcept
+    {
+        return next;
+    }
+
+    void record(detail::block_event e) const noexcept
+    {
+        counters.add(static_cast<std::size_t>(e), 1);
+    }
+
+    indirect_site_stats snapshot() const noexcept
+    {
+        auto constructions = count(detail::block_event::construct);
+        auto copies = count(detail::block_event::copy);
+        auto moves = count(detail::block_event::move);
+        auto destroys = count(detail::block_event::destroy);
+        return {file,
+                line,
+                function,
+                constructions,
+                copies + count(detail::block_event::assign),
+                moves,
+                destroys,
+                detail::live_count(constructions, copies, moves, destroys)};
+    }
+
+    void reset() const noexcept
+    {
+        counters.reset();
+    }
+
+private:
+    mutable detail::sharded_counters<5> counters;
+    indirect_call_site* next = nullptr;
+
+    std::size_t count(detail::block_event e) const noexcept
+    {
+        return counters.sum(static_cast<std::size_t>(e));
+    }
+};
+
+// The `indirect_call_site` of the line it is written on, in the function it
+// is written in. It is a macro because `std::source_location` is C++20 and
+// the library is built as C++17.
+#define INDIRECT_CALL_SITE                                                             \
+    ([](char const* function) -> ::indirect_call_site const& {                         \
+        static ::indirect_call_site const site(__FILE__, __LINE__, function);          \
+        return site;                                                                   \
+    }(__func__))
+
+// The counters of every control block type used so far. Counts are read with
+// relaxed loads, so a snapshot taken while other threads create blocks is
+// consistent per counter, not across counters.
+inline std::vector<indirect_block_stats> indirect_instrumentation_snapshot()
+{
+    std::vector<indirect_block_stats> stats;
+    for (auto c = detail::block_counters::head().load(std::memory_order_acquire); c; c = c->next)
+    {
+        stats.push_back(c->snapshot());
+    }
+    return stats;
+}
+
+// The counters of every call site used so far.
+inline std::vector<indirect_site_stats> indirect_instrumentation_sites()
+{
+    std::vector<indirect_site_stats> stats;
+    for (auto s = indirect_call_site::head().load(std::memory_order_acquire); s; s = s->next_site())
+    {
+        stats.push_back(s->snapshot());
+    }
+    return stats;
+}
+
+inline void indirect_instrumentation_reset() noexcept
+{
+    for (auto c = detail::block_counters::head().load(std::memory_order_acquire); c; c = c->next)
+    {
+        c->reset();
+    }
+    for (auto s = indirect_call_site::head().load(std::memory_order_acquire); s; s = s->next_site())
+    {
+        s->reset();
+    }
+}
+
+namespace detail
+{
+
+    // Formats a line of the dump into a fixed buffer, cutting it short
+    // rather than allocating.
+    class dump_line
+    {
+    private:
+        char text[512];
+        std::size_t size = 0;
+
+    public:
+        dump_line& operator<<(char const* s) noexcept
+        {
+            for (; s && *s && size < sizeof(text) - 1; ++s)
+            {
+                text[size++] = *s;
+            }
+            return *this;
+        }
+
+        dump_line& operator<<(std::size_t n) noexcept
+        {
+            char digits[20];
+            std::size_t count = 0;
+            do
+            {
+                digits[count++] = static_cast<char>('0' + n % 10);
+                n /= 10;
+            } while (n != 0);
+            while (count != 0 && size < sizeof(text) - 1)
+            {
+                text[size++] = digits[--count];
+            }
+            return *this;
+        }
+
+        void write(dump_writer w, void* context) noexcept
+        {
+            text[size++] = '\n';
+            w(text, size, context);
+        }
+    };
+
+} // namespace detail
+
+// Writes a line per control block type and per call site to `write`. It
+// neither allocates nor locks, so it can be called from a signal handler,
+// such as one for SIGUSR1; types are named as `std::type_info::name` names
+// them.
+inline void indirect_instrumentation_dump(detail::dump_writer write, void* context) noexcept
+{
+    for (auto c = detail::block_counters::head().load(std::memory_order_acquire); c; c = c->next)
+    {
+        auto s = c->snapshot();
+        detail::dump_line line;
+        line << "indirect " << s.block << " " << s.type->name() << " live=" << s.live
+             << " peak_bytes=" << s.peak_bytes << " constructions=" << s.constructions << " copies=" << s.copies
+             << " moves=" << s.moves << " destroys=" << s.destroys << " allocations=" << s.allocations
+             << " allocated_bytes=" << s.allocated_bytes;
+        line.write(write, context);
+    }
+    for (auto site = indirect_call_site::head().load(std::memory_order_acquire); site; site = site->next_site())
+    {
+        auto s = site->snapshot();
+        detail::dump_line line;
+        line << "indirect site " << s.file << ":" << static_cast<std::size_t>(s.line) << " " << s.function
+             << " live=" << s.live << " constructions=" << s.constructions << " copies=" << s.copies
+             << " moves=" << s.moves << " destroys=" << s.destroys;
+        line.write(write, context);
+    }
+}
+
+#else
+
+namespace detail
+{
+
+    template <typename Block>
+    void record(block_event) noexcept
+    {
+    }
+
+    template <typename Block>
+    void record_allocation(std::size_t) noexcept
+    {
+    }
+
+    template <typename Block>
+    void record_deallocation(std::size_t) noexcept
+    {
+    }
+
+} // namespace detail
+
+class indirect_call_site
+{
+public:
+    constexpr indirect_call_site() noexcept
+    {
+    }
+
+    constexpr indirect_call_site(char const*, int, char const*) noexcept
+    {
+    }
+};
+
+#define INDIRECT_CALL_SITE (::indirect_call_site())
+
+inline void indirect_instrumentation_dump(detail::dump_writer, void*) noexcept
+{
+}
+
+inline void indirect_instrumentation_dump(int) noexcept
+{
+}
+
+#endif
+
+#ifdef INDIRECT_HAS_UNISTD
+// Writes the dump to a file descriptor.
+inline void indirect_instrumentation_dump(int fd) noexcept
+{
+    indirect_instrumentation_dump(
+        [](char const* data, std::size_t size, void* context) {
+            auto fd = *static_cast<int*>(context);
+            while (size != 0)
+            {
+                auto n = ::write(fd, data, size);
+                if (n <= 0)
+                {
+                    return;
+                }
+                data += n;
+                size -= static_cast<std::size_t>(n);
+            }
+        },
+        &fd);
+}
+#endif
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <indirect.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace detail
+{
+
+    // Fewer elements than this per thread are copied faster than a thread
+    // is started.
+    constexpr std::size_t parallel_copy_grain = 4096;
+
+} // namespace detail
+
+// Copies `v` as its copy constructor would, cloning the elements on up to
+// `threads` threads (by default one per hardware thread), each copying one
+// contiguous range. Each thread allocates its clones the way it allocates
+// anything else: from its own malloc arena for `heap_storage`, and from its own
+// pools for `pooled_storage`. If any clone throws, the first exception is
+// rethrown once every thread has finished and nothing is leaked.
+template <typename T, typename S>
+std::vector<indirect<T, S>> parallel_copy(std::vector<indirect<T, S>> const& v, std::size_t threads = 0)
+{
+    if (threads == 0)
+    {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    threads = std::min(threads, std::max<std::size_t>(v.size() / detail::parallel_copy_grain, 1));
+    if (threads == 1)
+    {
+        return v;
+    }
+
+    // Empty elements are assigned to by the threads, so the vector never
+    // reallocates while they run.
+    std::vector<indirect<T, S>> r;
+    r.reserve(v.size());
+    for (std::size_t i = 0; i < v.size(); ++i)
+    {
+        r.push_back(detail::indirect_access::empty<T, S>());
+    }
+
+    std::vector<std::exception_ptr> errors(threads);
+    auto copy_range = [&](std::size_t t) {
+        auto first = v.size() * t / threads;
+        auto last = v.size() * (t + 1) / threads;
+        INDIRECT_TRY
+        {
+            for (auto i = first; i < last; ++i)
+            {
+                r[i] = v[i];
+            }
+        }
+        INDIRECT_CATCH_ALL
+        {
+            errors[t] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    INDIRECT_TRY
+    {
+        for (std::size_t t = 1; t < threads; ++t)
+        {
+            workers.emplace_back(copy_range, t);
+        }
+    }
+    INDIRECT_CATCH_ALL
+    {
+        // Copy what no thread could be started for on this one.
+        for (auto t = workers.size() + 1; t < threads; ++t)
+        {
+            copy_range(t);
+        }
+    }
+    copy_range(0);
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+
+    for (auto& e : errors)
+    {
+        if (e)
+        {
+            std::rethrow_exception(e);
+        }
+    }
+    return r;
+}
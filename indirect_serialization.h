@@ -0,0 +1,394 @@
+#pragma once
+
+#include <indirect.h>
+#include <indirect_array.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// An `indirect_registry<Base>` names the classes derived from `Base` that can
+// be stored by stable ids and writes `indirect<Base>`s, and vectors of them,
+// in a compact binary format:
+//
+//   indirect: u32 id, 0 if empty, then the object
+//   vector:   u64 size, then runs of consecutive elements of one type, each
+//             u32 id, u64 length, then the objects of the run
+//   arena:    u64 size, then a u64 offset per element, then the elements,
+//             each as an indirect; see `indirect_view.h`
+//
+// Numbers are in native byte order. Objects of a type U are written by
+// `indirect_serializer<U>::save(indirect_writer&, U const&)`, as at least one
+// byte, and read by `indirect_serializer<U>::load(indirect_reader&)`,
+// returning a U, which are to be specialized for each type registered. The registry finds a type by
+// the token in its control block, so writing a run looks a type up once, and
+// reading one calls the loader of its type directly for every element and
+// allocates the run's blocks together, as `make_indirect_array` does.
+class indirect_serialization_error : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+template <typename U>
+struct indirect_serializer;
+
+namespace detail
+{
+
+    [[noreturn]] inline void throw_serialization_error(char const* what)
+    {
+#ifdef INDIRECT_HAS_EXCEPTIONS
+        throw indirect_serialization_error(what);
+#else
+        (void)what;
+        std::abort();
+#endif
+    }
+
+} // namespace detail
+
+// Appends what is written to a byte buffer.
+class indirect_writer
+{
+private:
+    std::vector<char>& out;
+
+public:
+    explicit indirect_writer(std::vector<char>& out_) noexcept :
+        out(out_)
+    {
+    }
+
+    void write_bytes(void const* p, std::size_t n)
+    {
+        auto c = static_cast<char const*>(p);
+        out.insert(out.end(), c, c + n);
+    }
+
+    // The number of bytes in the buffer, at which the next write goes.
+    std::size_t position() const noexcept
+    {
+        return out.size();
+    }
+
+    // Overwrites bytes written before at `pos`.
+    template <typename V>
+    void write_at(std::size_t pos, V const& v) noexcept
+    {
+        static_assert(std::is_trivially_copyable<V>::value && !std::is_pointer<V>::value,
+                      "only values are written as bytes");
+        std::memcpy(out.data() + pos, &v, sizeof(V));
+    }
+
+    template <typename V>
+    void write(V const& v)
+    {
+        static_assert(std::is_trivially_copyable<V>::value && !std::is_pointer<V>::value,
+                      "only values are written as bytes");
+        write_bytes(&v, sizeof(V));
+    }
+};
+
+// Reads from a buffer in place, such as a memory-mapped file, without copying
+// it first; the buffer must outlive the pointers `read_bytes` returns into it.
+class indirect_reader
+{
+private:
+    char const* next;
+    char const* last;
+
+public:
+    indirect_reader(void const* data, std::size_t size) noexcept :
+        next(static_cast<char const*>(data)),
+        last(next + size)
+    {
+    }
+
+    char const* read_bytes(std::size_t n)
+    {
+        if (n > remaining())
+        {
+            detail::throw_serialization_error("indirect_reader: read past the end of the buffer");
+        }
+        auto p = next;
+        next += n;
+        return p;
+    }
+
+    template <typename V>
+    V read()
+    {
+        static_assert(std::is_trivially_copyable<V>::value && !std::is_pointer<V>::value,
+                      "only values are read as bytes");
+        V v;
+        std::memcpy(&v, read_bytes(sizeof(V)), sizeof(V));
+        return v;
+    }
+
+    std::size_t remaining() const noexcept
+    {
+        return static_cast<std::size_t>(last - next);
+    }
+};
+
+namespace detail
+{
+
+    // Per-type operations of an `indirect_registry`. `load_run` appends `n`
+    // objects read one after the other to `v`.
+    template <typename Base>
+    struct serial_vtable
+    {
+        void (*save)(indirect_writer& w, Base const& b);
+        indirect<Base> (*load)(indirect_reader& r);
+        void (*load_run)(indirect_reader& r, std::size_t n, std::vector<indirect<Base>>& v);
+    };
+
+    template <typename Base, typename U>
+    struct serial_vtable_for
+    {
+        static void save(indirect_writer& w, Base const& b)
+        {
+            indirect_serializer<U>::save(w, *exact_downcast<U>(&b, 0));
+        }
+
+        static indirect<Base> load(indirect_reader& r)
+        {
+            return indirect<Base>(indirect_serializer<U>::load(r));
+        }
+
+        static void load_run(indirect_reader& r, std::size_t n, std::vector<indirect<Base>>& v)
+        {
+            if (n == 1)
+            {
+                v.push_back(load(r));
+                return;
+            }
+            append_slab<Base, U>(v, n, [&](void* where, slab_header* slab) {
+                return ::new (where) slab_control_block<U>(slab, indirect_serializer<U>::load(r));
+            });
+        }
+
+        static constexpr serial_vtable<Base> value = {&save, &load, &load_run};
+    };
+
+    template <typename Base, typename U>
+    constexpr serial_vtable<Base> serial_vtable_for<Base, U>::value;
+
+} // namespace detail
+
+template <typename Base>
+class indirect_arena_view;
+
+template <typename Base>
+class indirect_registry
+{
+    friend class indirect_arena_view<Base>;
+
+private:
+    using vtable = detail::serial_vtable<Base>;
+
+    struct entry
+    {
+        std::uint32_t id;
+        vtable const* table;
+    };
+
+    std::unordered_map<detail::type_token, entry> by_type;
+    std::unordered_map<std::uint32_t, vtable const*> by_id;
+
+    entry const& find(detail::type_token type) const
+    {
+        auto e = by_type.find(type);
+        if (e == by_type.end())
+        {
+            detail::throw_serialization_error("indirect_registry: type not registered");
+        }
+        return e->second;
+    }
+
+    vtable const* find(std::uint32_t id) const
+    {
+        auto e = by_id.find(id);
+        if (e == by_id.end())
+        {
+            detail::throw_serialization_error("indirect_registry: unknown type id");
+        }
+        return e->second;
+    }
+
+    // An object written as no bytes would let a run claim more objects than
+    // its buffer holds without being caught before they are allocated.
+    static void save_object(indirect_writer& w, vtable const& table, Base const& b)
+    {
+        auto start = w.position();
+        table.save(w, b);
+        if (w.position() == start)
+        {
+            detail::throw_serialization_error("indirect_registry: object written as no bytes");
+        }
+    }
+
+public:
+    // Registers U under `id`, which must be neither 0, the id of an empty
+    // `indirect`, nor the id of another type.
+    template <typename U>
+    void add(std::uint32_t id)
+    {
+        static_assert(std::is_base_of<Base, U>::value, "U must be derived from Base");
+        auto type = &detail::type_token_for<U>::value;
+        if (id == 0 || by_id.count(id) || by_type.count(type))
+        {
+            detail::throw_serialization_error("indirect_registry: id or type already registered");
+        }
+        auto table = &detail::serial_vtable_for<Base, U>::value;
+        by_id.emplace(id, table);
+        INDIRECT_TRY
+        {
+            by_type.emplace(type, entry{id, table});
+        }
+        INDIRECT_CATCH_ALL
+        {
+            by_id.erase(id);
+            INDIRECT_RETHROW;
+        }
+    }
+
+    template <typename S>
+    void save(indirect_writer& w, indirect<Base, S> const& i) const
+    {
+        auto type = detail::indirect_access::type(i);
+        if (!type)
+        {
+            w.write(std::uint32_t{0});
+            return;
+        }
+        auto const& e = find(type);
+        w.write(e.id);
+        save_object(w, *e.table, *i);
+    }
+
+    template <typename S>
+    void save(indirect_writer& w, std::vector<indirect<Base, S>> const& v) const
+    {
+        w.write(static_cast<std::uint64_t>(v.size()));
+        for (std::size_t first = 0; first < v.size();)
+        {
+            auto type = detail::indirect_access::type(v[first]);
+            auto last = first + 1;
+            while (last < v.size() && detail::indirect_access::type(v[last]) == type)
+            {
+                ++last;
+            }
+            auto n = static_cast<std::uint64_t>(last - first);
+            if (!type)
+            {
+                w.write(std::uint32_t{0});
+                w.write(n);
+            }
+            else
+            {
+                auto const& e = find(type);
+                w.write(e.id);
+                w.write(n);
+                for (auto i = first; i < last; ++i)
+                {
+                    save_object(w, *e.table, *v[i]);
+                }
+            }
+            first = last;
+        }
+    }
+
+    // Writes the elements of `v` as an arena, read in place by an
+    // `indirect_arena_view`: u64 size, then the u64 offset of each element
+    // from the start of the arena, then each element as a single `indirect`.
+    template <typename S>
+    void save_arena(indirect_writer& w, std::vector<indirect<Base, S>> const& v) const
+    {
+        auto start = w.position();
+        w.write(static_cast<std::uint64_t>(v.size()));
+        auto offsets = w.position();
+        for (std::size_t i = 0; i < v.size(); ++i)
+        {
+            w.write(std::uint64_t{0});
+        }
+        for (std::size_t i = 0; i < v.size(); ++i)
+        {
+            w.write_at(offsets + i * sizeof(std::uint64_t), static_cast<std::uint64_t>(w.position() - start));
+            save(w, v[i]);
+        }
+    }
+
+    indirect<Base> load(indirect_reader& r) const
+    {
+        auto id = r.read<std::uint32_t>();
+        if (id == 0)
+        {
+            return detail::indirect_access::empty<Base, heap_storage>();
+        }
+        return find(id)->load(r);
+    }
+
+    // Reads a vector of no more elements than there are bytes left after its
+    // size, which a vector of mostly empty elements may exceed.
+    std::vector<indirect<Base>> load_vector(indirect_reader& r) const
+    {
+        auto size = r.read<std::uint64_t>();
+        return load_elements(r, size, r.remaining());
+    }
+
+    // Reads a vector of at most `max_size` elements. Empty elements take no
+    // bytes in a run, so only this limit keeps a buffer from claiming more of
+    // them than can be allocated.
+    std::vector<indirect<Base>> load_vector(indirect_reader& r, std::size_t max_size) const
+    {
+        auto size = r.read<std::uint64_t>();
+        return load_elements(r, size, max_size);
+    }
+
+private:
+    std::vector<indirect<Base>> load_elements(indirect_reader& r, std::uint64_t size, std::size_t max_size) const
+    {
+        if (size > max_size)
+        {
+            detail::throw_serialization_error("indirect_registry: vector larger than allowed");
+        }
+        std::vector<indirect<Base>> v;
+        // The size is not trusted for more than the buffer could hold.
+        v.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(size, r.remaining())));
+        while (v.size() < size)
+        {
+            auto id = r.read<std::uint32_t>();
+            auto n = r.read<std::uint64_t>();
+            if (n == 0 || n > size - v.size())
+            {
+                detail::throw_serialization_error("indirect_registry: run does not fit the vector");
+            }
+            // Each object takes at least a byte, so a run is checked against
+            // the buffer before its slab is allocated.
+            if (id != 0 && n > r.remaining())
+            {
+                detail::throw_serialization_error("indirect_registry: run longer than the buffer");
+            }
+            if (id == 0)
+            {
+                for (std::uint64_t i = 0; i < n; ++i)
+                {
+                    v.push_back(detail::indirect_access::empty<Base, heap_storage>());
+                }
+            }
+            else
+            {
+                find(id)->load_run(r, static_cast<std::size_t>(n), v);
+            }
+        }
+        return v;
+    }
+};
@@ -0,0 +1,407 @@
+#pragma once
+
+#include <indirect.h>
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// `indirect_vector<Base>` holds objects of classes derived from `Base`
+// grouped by dynamic type: the objects of each type are stored contiguously,
+// in insertion order, in a segment of their own, and segments are kept in the
+// order their types were first inserted. Visiting the elements segment by
+// segment keeps calls through `Base` monomorphic for a whole segment, and the
+// elements of types named in `for_each<Us...>` are visited as those types, so
+// calls on final types need no virtual dispatch. Copying an `indirect_vector`
+// copies every element, as copying a `std::vector<indirect<Base>>` does.
+template <typename Base>
+class indirect_vector;
+
+namespace detail
+{
+
+    // Per-type operations on arrays of the objects held by a segment. Unlike
+    // `block_vtable`, whose operations act on one control block and its
+    // object, these act on runs of bare objects with no block around them.
+    // `copy` and `relocate` construct into uninitialized storage and leave it
+    // empty if they throw; `relocate` also destroys its source.
+    template <typename Base>
+    struct segment_vtable
+    {
+        void (*copy)(void const* from, std::size_t n, void* to);
+        void (*relocate)(void* from, std::size_t n, void* to);
+        void (*destroy)(void* first, std::size_t n) noexcept;
+        Base* (*base)(void* p) noexcept;
+        std::size_t size;
+        std::size_t align;
+    };
+
+    template <typename Base, typename U>
+    struct segment_vtable_for
+    {
+        static void copy(void const* from, std::size_t n, void* to)
+        {
+            auto f = static_cast<U const*>(from);
+            auto t = static_cast<U*>(to);
+            std::size_t i = 0;
+            INDIRECT_TRY
+            {
+                for (; i < n; ++i)
+                {
+                    ::new (static_cast<void*>(t + i)) U(f[i]);
+                }
+            }
+            INDIRECT_CATCH_ALL
+            {
+                destroy(t, i);
+                INDIRECT_RETHROW;
+            }
+        }
+
+        static void relocate(void* from, std::size_t n, void* to)
+        {
+            auto f = static_cast<U*>(from);
+            auto t = static_cast<U*>(to);
+            std::size_t i = 0;
+            INDIRECT_TRY
+            {
+                for (; i < n; ++i)
+                {
+                    ::new (static_cast<void*>(t + i)) U(std::move_if_noexcept(f[i]));
+                }
+            }
+            INDIRECT_CATCH_ALL
+            {
+                destroy(t, i);
+                INDIRECT_RETHROW;
+            }
+            destroy(f, n);
+        }
+
+        static void destroy(void* first, std::size_t n) noexcept
+        {
+            auto p = static_cast<U*>(first);
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                p[i].~U();
+            }
+        }
+
+        static Base* base(void* p) noexcept
+        {
+            return static_cast<U*>(p);
+        }
+
+        static constexpr segment_vtable<Base> value = {&copy, &relocate, &destroy, &base, sizeof(U), alignof(U)};
+    };
+
+    template <typename Base, typename U>
+    constexpr segment_vtable<Base> segment_vtable_for<Base, U>::value;
+
+    // The objects of one dynamic type, stored contiguously.
+    template <typename Base>
+    class segment
+    {
+    private:
+        segment_vtable<Base> const* vtable;
+        void* data = nullptr;
+        std::size_t count = 0;
+        std::size_t capacity = 0;
+
+        void* slot(std::size_t i) const noexcept
+        {
+            return static_cast<char*>(data) + i * vtable->size;
+        }
+
+        // The new object is constructed before the old ones are relocated,
+        // since `ts` may refer to one of them.
+        template <typename U, typename... Ts>
+        U& grow_and_emplace(Ts&&... ts)
+        {
+            auto n = capacity ? 2 * capacity : 8;
+            auto d = allocate_bytes(n * vtable->size, vtable->align);
+            U* p = nullptr;
+            INDIRECT_TRY
+            {
+                p = ::new (static_cast<void*>(static_cast<char*>(d) + count * vtable->size)) U(std::forward<Ts>(ts)...);
+            }
+            INDIRECT_CATCH_ALL
+            {
+                deallocate_bytes(d, n * vtable->size, vtable->align);
+                INDIRECT_RETHROW;
+            }
+            if (data)
+            {
+                INDIRECT_TRY
+                {
+                    vtable->relocate(data, count, d);
+                }
+                INDIRECT_CATCH_ALL
+                {
+                    p->~U();
+                    deallocate_bytes(d, n * vtable->size, vtable->align);
+                    INDIRECT_RETHROW;
+                }
+                deallocate_bytes(data, capacity * vtable->size, vtable->align);
+            }
+            data = d;
+            capacity = n;
+            ++count;
+            return *p;
+        }
+
+    public:
+        explicit segment(segment_vtable<Base> const* vt) noexcept :
+            vtable(vt)
+        {
+        }
+
+        segment(segment const& other) :
+            vtable(other.vtable)
+        {
+            if (other.count)
+            {
+                data = allocate_bytes(other.count * vtable->size, vtable->align);
+                INDIRECT_TRY
+                {
+                    vtable->copy(other.data, other.count, data);
+                }
+                INDIRECT_CATCH_ALL
+                {
+                    deallocate_bytes(data, other.count * vtable->size, vtable->align);
+                    INDIRECT_RETHROW;
+                }
+                count = capacity = other.count;
+            }
+        }
+
+        segment(segment&& other) noexcept :
+            vtable(other.vtable),
+            data(other.data),
+            count(other.count),
+            capacity(other.capacity)
+        {
+            other.data = nullptr;
+            other.count = other.capacity = 0;
+        }
+
+        segment& operator=(segment other) noexcept
+        {
+            swap(other);
+            return *this;
+        }
+
+        void swap(segment& other) noexcept
+        {
+            using std::swap;
+            swap(vtable, other.vtable);
+            swap(data, other.data);
+            swap(count, other.count);
+            swap(capacity, other.capacity);
+        }
+
+        ~segment()
+        {
+            clear();
+            if (data)
+            {
+                deallocate_bytes(data, capacity * vtable->size, vtable->align);
+            }
+        }
+
+        bool holds(segment_vtable<Base> const* vt) const noexcept
+        {
+            return vtable == vt;
+        }
+
+        std::size_t size() const noexcept
+        {
+            return count;
+        }
+
+        template <typename U, typename... Ts>
+        U& emplace_back(Ts&&... ts)
+        {
+            if (count == capacity)
+            {
+                return grow_and_emplace<U>(std::forward<Ts>(ts)...);
+            }
+            auto p = ::new (slot(count)) U(std::forward<Ts>(ts)...);
+            ++count;
+            return *p;
+        }
+
+        void clear() noexcept
+        {
+            vtable->destroy(data, count);
+            count = 0;
+        }
+
+        // Every object of a segment has its `Base` at the same offset, which is
+        // found once rather than through the table for each element.
+        template <typename B, typename F>
+        void visit(F& f) const
+        {
+            if (!count)
+            {
+                return;
+            }
+            auto first = static_cast<char*>(data);
+            auto offset = reinterpret_cast<char*>(vtable->base(first)) - first;
+            auto stride = vtable->size;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                f(*reinterpret_cast<B*>(first + i * stride + offset));
+            }
+        }
+
+        template <typename U, typename F>
+        void visit_as(F& f) const
+        {
+            auto p = static_cast<U*>(data);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                f(p[i]);
+            }
+        }
+    };
+
+    template <typename Base, typename... Us>
+    struct segment_visitor;
+
+    template <typename Base>
+    struct segment_visitor<Base>
+    {
+        template <typename B, typename F>
+        static void visit(segment<Base> const& s, F& f)
+        {
+            s.template visit<B>(f);
+        }
+    };
+
+    template <typename Base, typename U, typename... Us>
+    struct segment_visitor<Base, U, Us...>
+    {
+        template <typename B, typename F>
+        static void visit(segment<Base> const& s, F& f)
+        {
+            if (s.holds(&segment_vtable_for<Base, U>::value))
+            {
+                s.template visit_as<std::conditional_t<std::is_const<B>::value, U const, U>>(f);
+            }
+            else
+            {
+                segment_visitor<Base, Us...>::template visit<B>(s, f);
+            }
+        }
+    };
+
+} // namespace detail
+
+template <typename Base>
+class indirect_vector
+{
+private:
+    std::vector<detail::segment<Base>> segments;
+    std::size_t elements = 0;
+
+    template <typename U>
+    detail::segment<Base>* find() const noexcept
+    {
+        auto vt = &detail::segment_vtable_for<Base, U>::value;
+        for (auto& s : segments)
+        {
+            if (s.holds(vt))
+            {
+                return const_cast<detail::segment<Base>*>(&s);
+            }
+        }
+        return nullptr;
+    }
+
+public:
+    indirect_vector() = default;
+
+    // Appends an object of type U, constructed from `ts...`, to U's segment.
+    template <typename U, typename... Ts>
+    U& emplace(Ts&&... ts)
+    {
+        static_assert(std::is_base_of<Base, U>::value, "U must be derived from Base");
+        auto s = find<U>();
+        if (!s)
+        {
+            segments.emplace_back(&detail::segment_vtable_for<Base, U>::value);
+            s = &segments.back();
+        }
+        auto& u = s->template emplace_back<U>(std::forward<Ts>(ts)...);
+        ++elements;
+        return u;
+    }
+
+    template <typename U, std::enable_if_t<std::is_base_of<Base, std::decay_t<U>>::value, int> = 0>
+    void push_back(U&& u)
+    {
+        emplace<std::decay_t<U>>(std::forward<U>(u));
+    }
+
+    std::size_t size() const noexcept
+    {
+        return elements;
+    }
+
+    // The number of elements whose dynamic type is U.
+    template <typename U>
+    std::size_t size() const noexcept
+    {
+        auto s = find<U>();
+        return s ? s->size() : 0;
+    }
+
+    bool empty() const noexcept
+    {
+        return elements == 0;
+    }
+
+    void clear() noexcept
+    {
+        segments.clear();
+        elements = 0;
+    }
+
+    void swap(indirect_vector& other) noexcept
+    {
+        using std::swap;
+        swap(segments, other.segments);
+        swap(elements, other.elements);
+    }
+
+    // Calls `f` with every element, segment by segment. Elements of the types
+    // `Us...` are passed as `U&`, others as `Base&`.
+    template <typename... Us, typename F>
+    F for_each(F f)
+    {
+        for (auto const& s : segments)
+        {
+            detail::segment_visitor<Base, Us...>::template visit<Base>(s, f);
+        }
+        return f;
+    }
+
+    template <typename... Us, typename F>
+    F for_each(F f) const
+    {
+        for (auto const& s : segments)
+        {
+            detail::segment_visitor<Base, Us...>::template visit<Base const>(s, f);
+        }
+        return f;
+    }
+};
+
+template <typename Base>
+void swap(indirect_vector<Base>& v1, indirect_vector<Base>& v2) noexcept
+{
+    v1.swap(v2);
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <indirect_serialization.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__has_include)
+#if __has_include(<sys/mman.h>) && __has_include(<sys/stat.h>) && __has_include(<fcntl.h>) && \
+    __has_include(<unistd.h>)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#define INDIRECT_HAS_MMAP 1
+#endif
+#endif
+
+// Read-only handles to the objects of an arena written by
+// `indirect_registry::save_arena`, typically in a memory-mapped file. Objects
+// with virtual functions cannot be used where another process laid them out,
+// so a view refers to an object's record in the arena and the object is only
+// constructed, in an `indirect` of its own, when it is loaded. Opening an
+// arena and taking views allocates nothing; a view's fields can be read in
+// place through its `reader`.
+template <typename Base>
+class indirect_view
+{
+    friend class indirect_arena_view<Base>;
+
+private:
+    using vtable = detail::serial_vtable<Base>;
+
+    vtable const* table = nullptr;
+    char const* first = nullptr;
+    std::size_t size = 0;
+
+    indirect_view(vtable const* t, char const* f, std::size_t n) noexcept :
+        table(t),
+        first(f),
+        size(n)
+    {
+    }
+
+public:
+    // A view of an empty element.
+    indirect_view() = default;
+
+    explicit operator bool() const noexcept
+    {
+        return table != nullptr;
+    }
+
+    template <typename U>
+    bool holds_type() const noexcept
+    {
+        return table == &detail::serial_vtable_for<Base, U>::value;
+    }
+
+    // Reads the object's record, as written by `indirect_serializer<U>::save`.
+    indirect_reader reader() const noexcept
+    {
+        return indirect_reader(first, size);
+    }
+
+    // Constructs a copy of the object, which can be modified.
+    indirect<Base> load() const
+    {
+        if (!table)
+        {
+            return detail::indirect_access::empty<Base, heap_storage>();
+        }
+        auto r = reader();
+        return table->load(r);
+    }
+};
+
+// The elements of an arena in a buffer that outlives the arena view and its
+// views. Only the arena's size is checked on opening; the offset and id of
+// an element are checked when it is viewed.
+template <typename Base>
+class indirect_arena_view
+{
+private:
+    indirect_registry<Base> const* registry;
+    char const* first;
+    std::size_t bytes;
+    std::size_t count;
+
+    std::uint64_t offset(std::size_t i) const noexcept
+    {
+        std::uint64_t o;
+        std::memcpy(&o, first + sizeof(std::uint64_t) * (i + 1), sizeof(o));
+        return o;
+    }
+
+public:
+    indirect_arena_view(indirect_registry<Base> const& r, void const* data, std::size_t size) :
+        registry(&r),
+        first(static_cast<char const*>(data)),
+        bytes(size)
+    {
+        auto n = indirect_reader(first, bytes).read<std::uint64_t>();
+        if (n > (bytes - sizeof(std::uint64_t)) / sizeof(std::uint64_t))
+        {
+            detail::throw_serialization_error("indirect_arena_view: offsets do not fit the buffer");
+        }
+        count = static_cast<std::size_t>(n);
+    }
+
+    std::size_t size() const noexcept
+    {
+        return count;
+    }
+
+    bool empty() const noexcept
+    {
+        return count == 0;
+    }
+
+    indirect_view<Base> operator[](std::size_t i) const
+    {
+        auto begin = offset(i);
+        auto end = i + 1 < count ? offset(i + 1) : bytes;
+        if (begin > end || end > bytes)
+        {
+            detail::throw_serialization_error("indirect_arena_view: element outside the buffer");
+        }
+        indirect_reader r(first + begin, static_cast<std::size_t>(end - begin));
+        auto id = r.read<std::uint32_t>();
+        if (id == 0)
+        {
+            return indirect_view<Base>();
+        }
+        auto n = r.remaining();
+        return indirect_view<Base>(registry->find(id), r.read_bytes(n), n);
+    }
+
+    // Loads every element into an `indirect` of its own.
+    std::vector<indirect<Base>> load() const
+    {
+        std::vector<indirect<Base>> v;
+        v.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            v.push_back((*this)[i].load());
+        }
+        return v;
+    }
+};
+
+#ifdef INDIRECT_HAS_MMAP
+// A whole file mapped read-only, unmapped when destroyed.
+class indirect_mapped_file
+{
+private:
+    void* address = nullptr;
+    std::size_t length = 0;
+
+    // Closes `fd`, if open, keeping the error that made opening fail.
+    [[noreturn]] static void fail(int fd, char const* path)
+    {
+        auto error = errno;
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+#ifdef INDIRECT_HAS_EXCEPTIONS
+        throw std::system_error(error, std::generic_category(), path);
+#else
+        (void)error;
+        (void)path;
+        std::abort();
+#endif
+    }
+
+public:
+    explicit indirect_mapped_file(char const* path)
+    {
+        int fd = ::open(path, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || ::fstat(fd, &st) != 0)
+        {
+            fail(fd, path);
+        }
+        length = static_cast<std::size_t>(st.st_size);
+        if (length != 0)
+        {
+            auto p = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED)
+            {
+                fail(fd, path);
+            }
+            address = p;
+        }
+        ::close(fd);
+    }
+
+    indirect_mapped_file(indirect_mapped_file&& other) noexcept :
+        address(other.address),
+        length(other.length)
+    {
+        other.address = nullptr;
+        other.length = 0;
+    }
+
+    indirect_mapped_file& operator=(indirect_mapped_file&& other) noexcept
+    {
+        std::swap(address, other.address);
+        std::swap(length, other.length);
+        return *this;
+    }
+
+    ~indirect_mapped_file()
+    {
+        if (address)
+        {
+            ::munmap(address, length);
+        }
+    }
+
+    void const* data() const noexcept
+    {
+        return address;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return length;
+    }
+};
+#endif
@@ -0,0 +1,377 @@
+#pragma once
+
+#include <indirect.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Storage policy for `indirect`: control blocks are taken from per-size-class
+// pools instead of the free store. Each thread owns the chunks it carves
+// blocks from. A block freed by its owning thread goes onto that thread's free
+// list; a block freed by any other thread is pushed, without locking, onto a
+// remote free list that the owner takes over in one exchange when its own list
+// runs dry. The pools of an exiting thread are adopted by the next thread that
+// needs one. Pooled memory is kept for reuse and never returned to the free
+// store. Blocks larger than `pool_max_block_size` or over-aligned blocks are
+// allocated as for `heap_storage`.
+template <typename Storage = heap_storage>
+struct pooled_storage
+{
+    static constexpr std::size_t size = Storage::size;
+    static constexpr std::size_t align = Storage::align;
+};
+
+template <typename T, typename Storage = heap_storage>
+using pooled_indirect = indirect<T, pooled_storage<Storage>>;
+
+namespace detail
+{
+
+    constexpr std::size_t pool_granularity = alignof(std::max_align_t);
+    constexpr std::size_t pool_max_block_size = 512;
+    constexpr std::size_t pool_chunk_size = 16 * 1024;
+
+    struct pool_node
+    {
+        pool_node* next;
+    };
+
+    template <typename Block>
+    struct pool_size_class
+    {
+        static constexpr std::size_t bytes = sizeof(Block) > sizeof(pool_node) ? sizeof(Block) : sizeof(pool_node);
+        static constexpr std::size_t value = (bytes + pool_granularity - 1) / pool_granularity * pool_granularity;
+        static constexpr bool poolable = value <= pool_max_block_size && alignof(Block) <= pool_granularity;
+    };
+
+    // Chunks are aligned to their size so that the chunk, and with it the
+    // owning pool, of a block is found by masking the block's address.
+    inline void* allocate_chunk()
+    {
+#ifdef __cpp_aligned_new
+        return ::operator new(pool_chunk_size, std::align_val_t(pool_chunk_size));
+#else
+        auto p = reinterpret_cast<std::uintptr_t>(::operator new(2 * pool_chunk_size));
+        return reinterpret_cast<void*>((p + pool_chunk_size - 1) & ~(pool_chunk_size - 1));
+#endif
+    }
+
+    template <std::size_t Size>
+    class block_pool;
+
+    template <std::size_t Size>
+    struct pool_chunk
+    {
+        block_pool<Size>* owner;
+
+        static constexpr std::size_t first = (sizeof(block_pool<Size>*) + pool_granularity - 1) / pool_granularity * pool_granularity;
+
+        static pool_chunk* of(void const* block) noexcept
+        {
+            return reinterpret_cast<pool_chunk*>(reinterpret_cast<std::uintptr_t>(block) & ~(pool_chunk_size - 1));
+        }
+    };
+
+    // The blocks of one size class owned by one thread at a time. Only the
+    // owner touches `local` and the chunk being carved; other threads only
+    // push onto `remote`, which the owner empties with a single exchange, so
+    // pushes never meet the ABA problem of a lock-free pop.
+    template <std::size_t Size>
+    class block_pool
+    {
+    private:
+        pool_node* local = nullptr;
+        char* carved = nullptr;
+        char* carved_end = nullptr;
+        std::atomic<pool_node*> remote{nullptr};
+        block_pool* next_abandoned = nullptr;
+
+        struct registry
+        {
+            std::mutex mutex;
+            block_pool* abandoned = nullptr;
+            // Serves threads whose own pool has already been abandoned at exit.
+            block_pool* shared = new block_pool;
+        };
+
+        // Never destroyed, so blocks can still be freed during static destruction.
+        static registry& global()
+        {
+            static registry* r = new registry;
+            return *r;
+        }
+
+        static block_pool*& current() noexcept
+        {
+            thread_local block_pool* pool = nullptr;
+            return pool;
+        }
+
+        static bool& exited() noexcept
+        {
+            thread_local bool e = false;
+            return e;
+        }
+
+        // Hands the thread's pool over to the next thread to start when this
+        // thread exits.
+        struct releaser
+        {
+            ~releaser()
+            {
+                auto pool = current();
+                current() = nullptr;
+                exited() = true;
+                auto& r = global();
+                std::lock_guard<std::mutex> lock(r.mutex);
+                pool->next_abandoned = r.abandoned;
+                r.abandoned = pool;
+            }
+        };
+
+        static block_pool& acquire()
+        {
+            auto& r = global();
+            {
+                std::lock_guard<std::mutex> lock(r.mutex);
+                if (auto pool = r.abandoned)
+                {
+                    r.abandoned = pool->next_abandoned;
+                    return *pool;
+                }
+            }
+            return *new block_pool;
+        }
+
+        static block_pool* local_pool()
+        {
+            if (auto pool = current())
+            {
+                return pool;
+            }
+            if (exited())
+            {
+                return nullptr;
+            }
+            current() = &acquire();
+            thread_local releaser release;
+            return current();
+        }
+
+        void* pop()
+        {
+            if (!local)
+            {
+                local = remote.exchange(nullptr, std::memory_order_acquire);
+            }
+            if (auto n = local)
+            {
+                local = n->next;
+                return n;
+            }
+            if (carved == carved_end)
+            {
+                auto chunk = static_cast<char*>(allocate_chunk());
+                ::new (static_cast<void*>(chunk)) pool_chunk<Size>{this};
+                carved = chunk + pool_chunk<Size>::first;
+                carved_end = carved + (pool_chunk_size - pool_chunk<Size>::first) / Size * Size;
+            }
+            auto p = carved;
+            carved += Size;
+            return p;
+        }
+
+        void push_remote(void* p) noexcept
+        {
+            auto n = ::new (p) pool_node{remote.load(std::memory_order_relaxed)};
+            while (!remote.compare_exchange_weak(n->next, n, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+        }
+
+    public:
+        static void* allocate()
+        {
+            if (auto pool = local_pool())
+            {
+                return pool->pop();
+            }
+            auto& r = global();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            return r.shared->pop();
+        }
+
+        static void deallocate(void* p) noexcept
+        {
+            auto owner = pool_chunk<Size>::of(p)->owner;
+            if (owner == current())
+            {
+                owner->local = ::new (p) pool_node{owner->local};
+            }
+            else
+            {
+                owner->push_remote(p);
+            }
+        }
+    };
+
+    template <typename Block>
+    using pool_for = block_pool<pool_size_class<Block>::value>;
+
+    template <typename T>
+    class pooled_control_block final : public control_block
+    {
+        template <typename>
+        friend struct vtable_for;
+
+    private:
+        T t;
+
+        pooled_control_block* clone(void* buffer) const
+        {
+            return create(buffer, t);
+        }
+
+        pooled_control_block* relocate(void* buffer)
+        {
+            return create(buffer, std::move(t));
+        }
+
+        void dispose() noexcept
+        {
+            this->~pooled_control_block();
+            pool_for<pooled_control_block>::deallocate(this);
+            record_deallocation<pooled_control_block>(sizeof(pooled_control_block));
+        }
+
+    public:
+        using value_type = T;
+
+        static constexpr char const* kind = "pooled";
+        static constexpr bool nothrow_move = std::is_nothrow_move_constructible<T>::value;
+
+        template <typename... Ts>
+        explicit pooled_control_block(Ts&&... ts) :
+            control_block{&vtable_for<pooled_control_block>::value},
+            t(std::forward<Ts>(ts)...)
+        {
+        }
+
+        static constexpr bool fits(std::size_t size, std::size_t align) noexcept
+        {
+            return fits_inline<pooled_control_block>(size, align);
+        }
+
+        template <typename... Ts>
+        static pooled_control_block* create(void* buffer, Ts&&... ts)
+        {
+            if (buffer)
+            {
+                return ::new (buffer) pooled_control_block(std::forward<Ts>(ts)...);
+            }
+            void* p = pool_for<pooled_control_block>::allocate();
+            INDIRECT_TRY
+            {
+                auto b = ::new (p) pooled_control_block(std::forward<Ts>(ts)...);
+                record_allocation<pooled_control_block>(sizeof(pooled_control_block));
+                return b;
+            }
+            INDIRECT_CATCH_ALL
+            {
+                pool_for<pooled_control_block>::deallocate(p);
+                INDIRECT_RETHROW;
+            }
+        }
+
+        static bool holds(control_block const& cb) noexcept
+        {
+            return cb.vtable == &vtable_for<pooled_control_block>::value;
+        }
+
+        T* get() noexcept
+        {
+            return &t;
+        }
+
+        T const& value() const noexcept
+        {
+            return t;
+        }
+    };
+
+    // Pooled blocks of one size class share a pool, whatever they hold.
+    template <std::size_t Size>
+    struct pool_memory
+    {
+        static constexpr memory_class value = {&block_pool<Size>::deallocate};
+    };
+
+    template <std::size_t Size>
+    constexpr memory_class pool_memory<Size>::value;
+
+    template <typename T>
+    struct memory_class_for<pooled_control_block<T>>
+    {
+        static constexpr memory_class const* value =
+            &pool_memory<pool_size_class<pooled_control_block<T>>::value>::value;
+    };
+
+    template <typename T>
+    constexpr memory_class const* memory_class_for<pooled_control_block<T>>::value;
+
+    template <typename U>
+    using pooled_block_t = std::conditional_t<pool_size_class<pooled_control_block<U>>::poolable,
+                                              pooled_control_block<U>, direct_control_block<U>>;
+
+    // Allocator-supplied blocks, moves and equality are as for `Storage`.
+    template <typename Storage>
+    class block_allocation<pooled_storage<Storage>> : public block_allocation<Storage>
+    {
+    public:
+        template <typename U>
+        using block_type = pooled_block_t<U>;
+
+        template <typename U, typename... Ts>
+        pooled_block_t<U>* emplace(void* buffer, Ts&&... ts) const
+        {
+            using block = pooled_block_t<U>;
+            auto b = block::create(block::fits(Storage::size, Storage::align) ? buffer : nullptr,
+                                   std::forward<Ts>(ts)...);
+            record<block>(block_event::construct);
+            return b;
+        }
+
+        template <typename Static>
+        control_block* copy(control_block const& cb, void* buffer) const
+        {
+            return copy(cb, buffer, static_cast<Static*>(nullptr), std::is_final<Static>());
+        }
+
+    private:
+        template <typename Static>
+        control_block* copy(control_block const& cb, void* buffer, Static*, std::false_type) const
+        {
+            return cb.vtable->copy(cb, buffer);
+        }
+
+        template <typename Static>
+        control_block* copy(control_block const& cb, void* buffer, Static*, std::true_type) const
+        {
+            using block = pooled_block_t<std::remove_cv_t<Static>>;
+            if (block::holds(cb))
+            {
+                auto b = block::create(buffer, static_cast<block const&>(cb).value());
+                record<block>(block_event::copy);
+                inherit_site(b, cb, block_event::copy);
+                return b;
+            }
+            return cb.vtable->copy(cb, buffer);
+        }
+    };
+
+} // namespace detail
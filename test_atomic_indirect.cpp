@@ -0,0 +1,239 @@
+#include <catch.hpp>
+#include <atomic_indirect.h>
+
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+    class policy
+    {
+    public:
+        static std::atomic<int> object_count;
+
+        policy() { ++object_count; }
+        policy(policy const&) { ++object_count; }
+        virtual ~policy() { --object_count; }
+        virtual int limit() const = 0;
+        virtual int check() const = 0;
+    };
+
+    std::atomic<int> policy::object_count{0};
+
+    // Keeps a copy of its limit that an object destroyed under a reader would
+    // no longer agree with.
+    class fixed_policy : public policy
+    {
+    private:
+        int n;
+        int negated;
+
+    public:
+        explicit fixed_policy(int i) : n(i), negated(-i) {}
+        ~fixed_policy() override { negated = 1; }
+        int limit() const override { return n; }
+        int check() const override { return n + negated; }
+    };
+
+} // namespace
+
+SCENARIO("`atomic_indirect` publishes objects to readers", "[atomic_indirect]")
+{
+    GIVEN("an `atomic_indirect<policy>` holding a policy")
+    {
+        atomic_indirect<policy> a(fixed_policy{1});
+
+        THEN("a load reads it")
+        {
+            auto h = a.load();
+            REQUIRE(h);
+            REQUIRE(h->limit() == 1);
+            REQUIRE((*h).limit() == 1);
+            REQUIRE(policy::object_count == 1);
+        }
+
+        THEN("repeated loads read the same object")
+        {
+            auto h1 = a.load();
+            auto h2 = a.load();
+            REQUIRE(&*h1 == &*h2);
+        }
+
+        WHEN("another policy is stored while a handle is held")
+        {
+            auto h = a.load();
+            a.store(fixed_policy{2});
+
+            THEN("new loads read the new policy and the handle the old one")
+            {
+                REQUIRE(a.load()->limit() == 2);
+                REQUIRE(h->limit() == 1);
+                REQUIRE(policy::object_count == 2);
+            }
+
+            THEN("the old policy is destroyed once the handle is released and reclaimed")
+            {
+                {
+                    auto released = std::move(h);
+                    REQUIRE(!h);
+                    REQUIRE(released->limit() == 1);
+                }
+                REQUIRE(policy::object_count == 2);
+                a.reclaim();
+                REQUIRE(policy::object_count == 1);
+            }
+        }
+
+        WHEN("another policy is stored while no handle is held")
+        {
+            a.store(fixed_policy{2});
+
+            THEN("the old policy is destroyed at once")
+            {
+                REQUIRE(policy::object_count == 1);
+            }
+        }
+
+        WHEN("a handle is shared")
+        {
+            auto shared = a.load().share();
+            a.store(fixed_policy{2});
+
+            THEN("the `cow_indirect` keeps the object alive")
+            {
+                REQUIRE(shared->limit() == 1);
+                REQUIRE(shared.use_count() == 1);
+                REQUIRE(policy::object_count == 2);
+            }
+        }
+
+        WHEN("the published block is shared")
+        {
+            auto const shared = a.load().share();
+            auto before = policy::object_count.load();
+
+            THEN("loads read the shared object without copying it")
+            {
+                auto h1 = a.load();
+                auto h2 = a.load();
+                REQUIRE(&*h1 == &*shared);
+                REQUIRE(&*h2 == &*shared);
+                REQUIRE(shared.use_count() == 2);
+                REQUIRE(policy::object_count == before);
+            }
+        }
+
+        WHEN("the stored `cow_indirect` is kept")
+        {
+            cow_indirect<policy> const kept{fixed_policy{6}};
+            a.store(kept);
+
+            THEN("loads read the kept object without copying it")
+            {
+                REQUIRE(&*a.load() == &*kept);
+                REQUIRE(kept.use_count() == 2);
+                REQUIRE(policy::object_count == 1);
+            }
+        }
+
+        WHEN("a policy is exchanged")
+        {
+            auto old = a.exchange(fixed_policy{3});
+
+            THEN("the previous policy is returned")
+            {
+                REQUIRE(old->limit() == 1);
+                REQUIRE(a.load()->limit() == 3);
+                REQUIRE(policy::object_count == 2);
+            }
+        }
+
+        WHEN("a policy is compared and exchanged")
+        {
+            auto expected = a.load();
+            auto stale = a.load();
+
+            THEN("it is published if the expected policy is still current")
+            {
+                REQUIRE(a.compare_exchange(expected, fixed_policy{4}));
+                REQUIRE(a.load()->limit() == 4);
+                REQUIRE(expected->limit() == 1);
+
+                AND_THEN("a handle loaded before fails and is reloaded")
+                {
+                    REQUIRE(!a.compare_exchange(stale, fixed_policy{5}));
+                    REQUIRE(stale->limit() == 4);
+                    REQUIRE(a.load()->limit() == 4);
+                    REQUIRE(a.compare_exchange(stale, fixed_policy{5}));
+                    REQUIRE(a.load()->limit() == 5);
+                }
+            }
+        }
+    }
+
+    REQUIRE(policy::object_count == 0);
+}
+
+SCENARIO("`atomic_indirect` is read while it is replaced", "[atomic_indirect][thread]")
+{
+    GIVEN("readers loading an `atomic_indirect` that a writer replaces")
+    {
+        constexpr int reader_count = 4;
+        constexpr int store_count = 2000;
+        atomic_indirect<policy> a(fixed_policy{0});
+        std::atomic<bool> done{false};
+        std::atomic<int> bad{0};
+
+        std::vector<std::thread> readers;
+        for (int t = 0; t < reader_count; ++t)
+        {
+            readers.emplace_back([&, t] {
+                cow_indirect<policy> kept{fixed_policy{0}};
+                while (!done.load(std::memory_order_acquire))
+                {
+                    auto h = a.load();
+                    auto again = a.load();
+                    if (h->check() != 0 || again->check() != 0)
+                    {
+                        ++bad;
+                    }
+                    // One reader also replaces the policy with one it derives from
+                    // it, and another keeps a share of the policy it read, so
+                    // that the others load blocks that are shared.
+                    if (t == 0)
+                    {
+                        a.compare_exchange(again, fixed_policy{again->limit() + 1});
+                    }
+                    else if (t == 1)
+                    {
+                        kept = h.share();
+                    }
+                }
+            });
+        }
+        for (int i = 1; i <= store_count; ++i)
+        {
+            auto old = a.exchange(fixed_policy{a.load()->limit() + 1});
+            (void)old;
+        }
+        done.store(true, std::memory_order_release);
+        for (auto& r : readers)
+        {
+            r.join();
+        }
+
+        THEN("every object read was alive and no object is leaked")
+        {
+            REQUIRE(bad == 0);
+            REQUIRE(a.load()->limit() >= store_count);
+            REQUIRE(a.load()->check() == 0);
+            a.reclaim();
+            REQUIRE(policy::object_count == 1);
+        }
+    }
+
+    REQUIRE(policy::object_count == 0);
+}
@@ -0,0 +1,366 @@
+#include <catch.hpp>
+#include <closed_indirect.h>
+#include <indirect.h>
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace
+{
+
+    class base
+    {
+    public:
+        static size_t object_count;
+
+        base() { ++object_count; }
+        base(base const&) { ++object_count; }
+        virtual ~base() { --object_count; }
+        virtual int value() const = 0;
+        virtual void set_value(int) = 0;
+    };
+
+    size_t base::object_count = 0u;
+
+    class derived : public base
+    {
+    private:
+        int v;
+
+    public:
+        derived(int i = 0) : v(i) {}
+        int value() const override { return v; }
+        void set_value(int i) override { v = i; }
+    };
+
+    class more_derived : public derived
+    {
+    public:
+        std::string name;
+
+        more_derived(int i, std::string n) : derived(i), name(std::move(n)) {}
+    };
+
+    class derived_other : public base
+    {
+    private:
+        int v;
+        int padding[3] = {};
+
+    public:
+        derived_other(int i) : v(i) {}
+        int value() const override { return v; }
+        void set_value(int i) override { v = i; }
+    };
+
+    class throwing : public base
+    {
+    public:
+        throwing() = default;
+        throwing(throwing const&) { throw std::runtime_error("copy"); }
+        int value() const override { return -1; }
+        void set_value(int) override {}
+    };
+
+    using closed = closed_indirect<base, derived, more_derived, derived_other>;
+
+} // namespace
+
+SCENARIO("`closed_indirect` holds an object of its closed set inline", "[closed_indirect]")
+{
+    GIVEN("a default-constructed `closed_indirect`")
+    {
+        closed c;
+
+        THEN("it holds a value-initialized object of the first type")
+        {
+            REQUIRE(c);
+            REQUIRE(c.holds_type<derived>());
+            REQUIRE(c.index() == 0);
+            REQUIRE(c->value() == 0);
+        }
+
+        THEN("its object is inside it")
+        {
+            auto p = reinterpret_cast<char const*>(&*c);
+            auto self = reinterpret_cast<char const*>(&c);
+            REQUIRE(p >= self);
+            REQUIRE(p < self + sizeof(c));
+        }
+    }
+
+    GIVEN("a `closed_indirect` made from an object of the set")
+    {
+        closed c{more_derived{3, "three"}};
+
+        THEN("the index names its type")
+        {
+            REQUIRE(c.index() == 1);
+            REQUIRE(c.holds_type<more_derived>());
+            REQUIRE(!c.holds_type<derived>());
+            REQUIRE(c->value() == 3);
+        }
+
+        WHEN("it is copied")
+        {
+            auto copy = c;
+            copy->set_value(4);
+
+            THEN("the copy is an independent object of the same type")
+            {
+                REQUIRE(copy.holds_type<more_derived>());
+                REQUIRE(copy->value() == 4);
+                REQUIRE(c->value() == 3);
+                REQUIRE(base::object_count == 2);
+            }
+        }
+
+        WHEN("it is moved")
+        {
+            auto moved = std::move(c);
+
+            THEN("the source is left empty")
+            {
+                REQUIRE(moved->value() == 3);
+                REQUIRE(!c);
+                REQUIRE(c.index() == 3);
+                REQUIRE(base::object_count == 1);
+            }
+        }
+
+        WHEN("it is assigned an object of another type")
+        {
+            c = derived_other{5};
+
+            THEN("the object and the index are replaced")
+            {
+                REQUIRE(c.holds_type<derived_other>());
+                REQUIRE(c->value() == 5);
+                REQUIRE(base::object_count == 1);
+            }
+        }
+
+        WHEN("another type is emplaced")
+        {
+            auto& d = c.emplace<derived>(6);
+
+            THEN("a reference to the new object is returned")
+            {
+                REQUIRE(&d == &*c);
+                REQUIRE(c.holds_type<derived>());
+                REQUIRE(c->value() == 6);
+            }
+        }
+
+        WHEN("it is swapped with one of another type")
+        {
+            closed other{derived_other{7}};
+            swap(c, other);
+
+            THEN("the objects are exchanged")
+            {
+                REQUIRE(c.holds_type<derived_other>());
+                REQUIRE(c->value() == 7);
+                REQUIRE(other.holds_type<more_derived>());
+                REQUIRE(other->value() == 3);
+            }
+        }
+    }
+
+    GIVEN("two `closed_indirect`s holding objects of the same type")
+    {
+        closed a{derived{1}};
+        closed b{derived{2}};
+        auto object = &*a;
+
+        WHEN("one is copy-assigned to the other")
+        {
+            a = b;
+
+            THEN("the object is assigned in place")
+            {
+                REQUIRE(&*a == object);
+                REQUIRE(a->value() == 2);
+            }
+        }
+    }
+
+    GIVEN("a `closed_indirect` whose object throws when copied")
+    {
+        closed_indirect<base, derived, throwing> c{derived{1}};
+        closed_indirect<base, derived, throwing> t;
+        t.emplace<throwing>();
+
+        THEN("an assignment that throws leaves the target unchanged")
+        {
+            REQUIRE_THROWS_AS(c = t, std::runtime_error);
+            REQUIRE(c.holds_type<derived>());
+            REQUIRE(c->value() == 1);
+        }
+
+        THEN("an emplace that throws leaves it empty")
+        {
+            throwing const source;
+            REQUIRE_THROWS_AS(c.emplace<throwing>(source), std::runtime_error);
+            REQUIRE(!c);
+        }
+    }
+
+    GIVEN("a const `closed_indirect`")
+    {
+        closed const c{derived{1}};
+
+        THEN("its object is const")
+        {
+            REQUIRE((std::is_same<decltype(*c), base const&>::value));
+            REQUIRE((std::is_same<decltype(c.operator->()), base const*>::value));
+        }
+    }
+
+    REQUIRE(base::object_count == 0);
+}
+
+SCENARIO("`closed_indirect` converts to and from `indirect`", "[closed_indirect][indirect]")
+{
+    GIVEN("an `indirect<base>` holding a type of the closed set")
+    {
+        indirect<base> i{derived_other{8}};
+
+        WHEN("a `closed_indirect` is copied from it")
+        {
+            closed c(i);
+
+            THEN("both hold the object")
+            {
+                REQUIRE(c.holds_type<derived_other>());
+                REQUIRE(c->value() == 8);
+                REQUIRE(i->value() == 8);
+                REQUIRE(base::object_count == 2);
+            }
+        }
+
+        WHEN("a `closed_indirect` is moved from it")
+        {
+            closed c(std::move(i));
+
+            THEN("the `indirect` is left empty")
+            {
+                REQUIRE(c->value() == 8);
+                REQUIRE(!i);
+                REQUIRE(base::object_count == 1);
+            }
+        }
+    }
+
+    GIVEN("an `indirect<base>` holding a type outside the closed set")
+    {
+        indirect<base> i{derived_other{1}};
+
+        THEN("converting it throws")
+        {
+            using narrow = closed_indirect<base, derived, more_derived>;
+            REQUIRE_THROWS_AS(narrow(i), bad_indirect_cast);
+            REQUIRE_THROWS_AS(narrow(std::move(i)), bad_indirect_cast);
+            REQUIRE(i);
+        }
+    }
+
+    GIVEN("an empty `indirect<base>`")
+    {
+        indirect<base> i{derived{1}};
+        auto taken = std::move(i);
+
+        THEN("the `closed_indirect` made from it is empty")
+        {
+            closed c(i);
+            REQUIRE(!c);
+        }
+    }
+
+    GIVEN("a `closed_indirect`")
+    {
+        closed c{more_derived{9, "nine"}};
+
+        WHEN("it is converted to an `indirect<base>`")
+        {
+            indirect<base> i = c;
+
+            THEN("the `indirect` holds a copy of the same type")
+            {
+                REQUIRE(i.holds_type<more_derived>());
+                REQUIRE(i->value() == 9);
+                REQUIRE(c->value() == 9);
+            }
+        }
+
+        WHEN("it is moved into an `indirect<derived, inline_storage<64>>`")
+        {
+            closed_indirect<derived, derived, more_derived> d{more_derived{10, "ten"}};
+            indirect<derived, inline_storage<64>> i = std::move(d);
+
+            THEN("the object is moved and the source left empty")
+            {
+                REQUIRE(i->value() == 10);
+                REQUIRE(!d);
+            }
+        }
+    }
+
+    REQUIRE(base::object_count == 0);
+}
+
+SCENARIO("Casting `closed_indirect`s", "[closed_indirect][cast]")
+{
+    GIVEN("a `closed_indirect<base>` holding a `more_derived`")
+    {
+        closed c{more_derived{1, "one"}};
+
+        THEN("a cast to `derived` keeps the types of the set derived from it")
+        {
+            auto d = static_indirect_cast<derived>(c);
+            REQUIRE((std::is_same<decltype(d), closed_indirect<derived, derived, more_derived>>::value));
+            REQUIRE(d.holds_type<more_derived>());
+            REQUIRE(d->value() == 1);
+            REQUIRE(c->value() == 1);
+        }
+
+        THEN("a dynamic cast to `derived` copies the object")
+        {
+            auto d = dynamic_indirect_cast<derived>(c);
+            REQUIRE(d.index() == 1);
+            REQUIRE(base::object_count == 2);
+        }
+
+        THEN("a cast of an rvalue moves the object and empties the source")
+        {
+            auto d = static_indirect_cast<derived>(std::move(c));
+            REQUIRE(d->value() == 1);
+            REQUIRE(!c);
+        }
+
+        THEN("an exact cast to the dynamic type succeeds")
+        {
+            auto m = exact_indirect_cast<more_derived>(c);
+            REQUIRE(m->name == "one");
+            REQUIRE(exact_indirect_cast_view<more_derived>(c)->name == "one");
+        }
+
+        THEN("casts to types it does not hold throw")
+        {
+            REQUIRE_THROWS_AS(dynamic_indirect_cast<derived_other>(c), bad_indirect_cast);
+            REQUIRE_THROWS_AS(static_indirect_cast<derived_other>(std::move(c)), bad_indirect_cast);
+            REQUIRE(c);
+            REQUIRE_THROWS_AS(exact_indirect_cast<derived>(c), bad_indirect_cast);
+            REQUIRE(!exact_indirect_cast_view<derived>(c));
+        }
+
+        THEN("cast views to a base of its object succeed")
+        {
+            REQUIRE(dynamic_indirect_cast_view<derived>(c)->value() == 1);
+            REQUIRE(!dynamic_indirect_cast_view<derived_other>(c));
+        }
+    }
+
+    REQUIRE(base::object_count == 0);
+}
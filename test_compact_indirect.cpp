@@ -0,0 +1,205 @@
+#include <catch.hpp>
+#include <compact_indirect.h>
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+    class base
+    {
+    public:
+        virtual ~base() = default;
+        virtual int get_value() const = 0;
+        virtual void set_value(int) = 0;
+    };
+
+    class other_base
+    {
+    public:
+        virtual ~other_base() = default;
+        long long padding[2] = {};
+    };
+
+    class derived : public base
+    {
+    private:
+        int value;
+
+    public:
+        static size_t object_count;
+
+    public:
+        derived() : value() { ++object_count; }
+        derived(derived const& other) : value(other.value) { ++object_count; }
+        derived(int v) : value(v) { ++object_count; }
+        ~derived() { --object_count; }
+        int get_value() const override { return value; }
+        void set_value(int i) override { value = i; }
+    };
+
+    size_t derived::object_count = 0u;
+
+    // `base` is not the first base class, so it lives at a non-zero offset.
+    class multiply_derived : public other_base, public derived
+    {
+    public:
+        using derived::derived;
+    };
+
+    struct plain
+    {
+        int value = 0;
+    };
+
+    struct plain_derived : plain
+    {
+    };
+
+    // A polymorphic type with a non-polymorphic base.
+    struct plain_tagged : plain, derived
+    {
+    };
+
+    template <typename T, typename I, typename = void>
+    struct can_static_cast : std::false_type
+    {
+    };
+
+    template <typename T, typename I>
+    struct can_static_cast<T, I, decltype((void)static_indirect_cast<T>(std::declval<I>()))> : std::true_type
+    {
+    };
+
+    template <typename T, typename I, typename = void>
+    struct can_dynamic_cast : std::false_type
+    {
+    };
+
+    template <typename T, typename I>
+    struct can_dynamic_cast<T, I, decltype((void)dynamic_indirect_cast<T>(std::declval<I>()))> : std::true_type
+    {
+    };
+
+    struct alignas(64) over_aligned : base
+    {
+        int value = 0;
+        int get_value() const override { return value; }
+        void set_value(int i) override { value = i; }
+    };
+
+} // namespace
+
+SCENARIO("`compact_indirect` is one pointer wide", "[compact]")
+{
+    static_assert(sizeof(compact_indirect<base>) == sizeof(void*), "");
+    static_assert(std::is_nothrow_move_constructible<compact_indirect<base>>::value, "");
+    static_assert(std::is_constructible<compact_indirect<base>, compact_indirect<multiply_derived>>::value, "");
+    static_assert(!std::is_constructible<compact_indirect<plain>, plain_derived>::value,
+                  "the most derived object of a non-polymorphic type cannot be recovered");
+    static_assert(can_static_cast<base, compact_indirect<plain_tagged> const&>::value, "");
+    static_assert(can_static_cast<derived, compact_indirect<base>>::value, "");
+    static_assert(can_static_cast<plain, compact_indirect<plain>>::value, "");
+    static_assert(!can_static_cast<plain, compact_indirect<plain_tagged> const&>::value,
+                  "a cast to a non-polymorphic base could not find the block");
+    static_assert(!can_static_cast<plain, compact_indirect<plain_tagged>>::value, "");
+    static_assert(!can_dynamic_cast<plain, compact_indirect<plain_tagged> const&>::value, "");
+    static_assert(!can_dynamic_cast<plain, compact_indirect<plain_tagged>>::value, "");
+}
+
+SCENARIO("`compact_indirect` can be copied and moved", "[compact][copy][move]")
+{
+    GIVEN("a `compact_indirect<base>` holding a `derived`")
+    {
+        compact_indirect<base> b1 = make_compact_indirect<derived>(42);
+
+        REQUIRE(derived::object_count == 1);
+
+        WHEN("it is copied")
+        {
+            compact_indirect<base> b2{b1};
+            b2->set_value(7);
+
+            REQUIRE(derived::object_count == 2);
+            REQUIRE(b1->get_value() == 42);
+            REQUIRE(b2->get_value() == 7);
+        }
+
+        WHEN("it is moved")
+        {
+            compact_indirect<base> b2{std::move(b1)};
+
+            REQUIRE(!b1);
+            REQUIRE(derived::object_count == 1);
+            REQUIRE(b2->get_value() == 42);
+        }
+
+        WHEN("it is copy assigned")
+        {
+            compact_indirect<base> b2 = make_compact_indirect<derived>(7);
+            b2 = b1;
+
+            REQUIRE(derived::object_count == 2);
+            REQUIRE(b2->get_value() == 42);
+        }
+
+        WHEN("it is cast back to `compact_indirect<derived>`")
+        {
+            auto d1 = dynamic_indirect_cast<derived>(b1);
+            auto d2 = static_indirect_cast<derived>(std::move(b1));
+
+            REQUIRE(derived::object_count == 2);
+            REQUIRE(d1->get_value() == 42);
+            REQUIRE(d2->get_value() == 42);
+            REQUIRE_THROWS_AS(dynamic_indirect_cast<multiply_derived>(d1), bad_indirect_cast);
+        }
+    }
+
+    REQUIRE(derived::object_count == 0);
+}
+
+SCENARIO("`compact_indirect` handles base subobjects at non-zero offsets", "[compact][offset]")
+{
+    GIVEN("a `compact_indirect<base>` holding a `multiply_derived`")
+    {
+        compact_indirect<multiply_derived> m1{in_place, 42};
+        compact_indirect<base> b1{m1};
+
+        REQUIRE(static_cast<void const*>(&*b1) != dynamic_cast<void const*>(&*b1));
+
+        WHEN("it is copied")
+        {
+            compact_indirect<base> b2{b1};
+
+            REQUIRE(derived::object_count == 3);
+            REQUIRE(b2->get_value() == 42);
+        }
+
+        WHEN("it is moved into a vector that grows")
+        {
+            std::vector<compact_indirect<base>> v;
+            v.push_back(std::move(b1));
+            v.push_back(v.front());
+            v.push_back(make_compact_indirect<derived>(7));
+
+            REQUIRE(derived::object_count == 4);
+            REQUIRE(v[1]->get_value() == 42);
+            REQUIRE(v[2]->get_value() == 7);
+        }
+    }
+
+    REQUIRE(derived::object_count == 0);
+}
+
+SCENARIO("`compact_indirect` supports over-aligned types", "[compact][align]")
+{
+    compact_indirect<base> b1{over_aligned{}};
+    b1->set_value(42);
+    compact_indirect<base> b2{b1};
+
+    REQUIRE(reinterpret_cast<std::uintptr_t>(&*b2) % 64 == 0);
+    REQUIRE(b2->get_value() == 42);
+}
@@ -0,0 +1,204 @@
+#include <catch.hpp>
+#include <cow_indirect.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+    class base
+    {
+    public:
+        virtual ~base() = default;
+        virtual int get_value() const = 0;
+        virtual void set_value(int) = 0;
+    };
+
+    class other_base
+    {
+    public:
+        virtual ~other_base() = default;
+        long long padding[2] = {};
+    };
+
+    class derived : public base
+    {
+    private:
+        int value;
+
+    public:
+        static std::atomic<size_t> object_count;
+
+    public:
+        derived() : value() { ++object_count; }
+        derived(derived const& other) : value(other.value) { ++object_count; }
+        derived(int v) : value(v) { ++object_count; }
+        ~derived() { --object_count; }
+        int get_value() const override { return value; }
+        void set_value(int i) override { value = i; }
+    };
+
+    std::atomic<size_t> derived::object_count{0u};
+
+    class multiply_derived : public other_base, public derived
+    {
+    public:
+        using derived::derived;
+    };
+
+    struct confined
+    {
+        int value = 0;
+    };
+
+} // namespace
+
+template <>
+struct cow_thread_confined<confined> : std::true_type
+{
+};
+
+SCENARIO("`cow_indirect` copies share the object until it is modified", "[cow][copy]")
+{
+    GIVEN("a `cow_indirect<base>` and a copy of it")
+    {
+        cow_indirect<base> b1{derived{42}};
+        cow_indirect<base> b2{b1};
+
+        THEN("both refer to one object")
+        {
+            REQUIRE(derived::object_count == 1);
+            REQUIRE(b1.use_count() == 2);
+            REQUIRE(&*static_cast<cow_indirect<base> const&>(b1) == &*static_cast<cow_indirect<base> const&>(b2));
+        }
+
+        WHEN("the copy is read through a const reference")
+        {
+            auto const& c2 = b2;
+
+            REQUIRE(c2->get_value() == 42);
+            REQUIRE(derived::object_count == 1);
+        }
+
+        WHEN("the copy is modified")
+        {
+            b2->set_value(7);
+
+            THEN("it gets its own object and the original is unchanged")
+            {
+                REQUIRE(derived::object_count == 2);
+                REQUIRE(b1.use_count() == 1);
+                REQUIRE(b2.use_count() == 1);
+                REQUIRE(b1->get_value() == 42);
+                REQUIRE(b2->get_value() == 7);
+            }
+        }
+
+        WHEN("the original is modified after the copy is destroyed")
+        {
+            b2 = cow_indirect<base>{derived{1}};
+            b1->set_value(7);
+
+            REQUIRE(derived::object_count == 2);
+            REQUIRE(b1->get_value() == 7);
+            REQUIRE(b2->get_value() == 1);
+        }
+    }
+
+    REQUIRE(derived::object_count == 0);
+}
+
+SCENARIO("`cow_indirect` can be moved and cast", "[cow][move][cast]")
+{
+    GIVEN("a `cow_indirect<base>` holding a `multiply_derived`")
+    {
+        cow_indirect<multiply_derived> m1{in_place, 42};
+        cow_indirect<base> b1{m1};
+
+        REQUIRE(b1.use_count() == 2);
+
+        WHEN("it is moved")
+        {
+            cow_indirect<base> b2{std::move(b1)};
+
+            REQUIRE(!b1);
+            REQUIRE(b2.use_count() == 2);
+        }
+
+        WHEN("it is cast back and modified")
+        {
+            auto d1 = dynamic_indirect_cast<derived>(b1);
+            REQUIRE(d1.use_count() == 3);
+
+            d1->set_value(7);
+            auto d2 = static_indirect_cast<multiply_derived>(std::move(d1));
+
+            REQUIRE(derived::object_count == 2);
+            REQUIRE(b1->get_value() == 42);
+            REQUIRE(d2->get_value() == 7);
+            REQUIRE_THROWS_AS(dynamic_indirect_cast<multiply_derived>(cow_indirect<base>{derived{}}), bad_indirect_cast);
+        }
+
+        WHEN("copies are kept in a vector and modified")
+        {
+            std::vector<cow_indirect<base>> v(3, b1);
+            v[1]->set_value(1);
+
+            REQUIRE(derived::object_count == 2);
+            REQUIRE(v[0].use_count() == 4);
+            REQUIRE(v[1]->get_value() == 1);
+            REQUIRE(v[2]->get_value() == 42);
+        }
+    }
+
+    REQUIRE(derived::object_count == 0);
+}
+
+SCENARIO("`cow_indirect` copies can be shared between threads", "[cow][thread]")
+{
+    GIVEN("a snapshot read and modified by many threads")
+    {
+        cow_indirect<base> const snapshot{derived{42}};
+        std::vector<std::thread> readers;
+        std::vector<int> seen(8);
+        for (int i = 0; i < 8; ++i)
+        {
+            readers.emplace_back([&, i] {
+                for (int j = 0; j < 1000; ++j)
+                {
+                    cow_indirect<base> copy = snapshot;
+                    copy->set_value(copy->get_value() + i);
+                    seen[i] = copy->get_value();
+                }
+            });
+        }
+        for (auto& r : readers)
+        {
+            r.join();
+        }
+
+        THEN("the snapshot is unchanged and every copy was released")
+        {
+            REQUIRE(snapshot.use_count() == 1);
+            REQUIRE(snapshot->get_value() == 42);
+            REQUIRE(seen[3] == 45);
+            REQUIRE(derived::object_count == 1);
+        }
+    }
+
+    REQUIRE(derived::object_count == 0);
+}
+
+SCENARIO("`cow_indirect` of a thread-confined type counts without atomics", "[cow][confined]")
+{
+    cow_indirect<confined> c1{};
+    auto c2 = c1;
+    c2->value = 1;
+
+    REQUIRE(sizeof(detail::cow_block<true>) == sizeof(detail::cow_block<false>));
+    REQUIRE(c1.use_count() == 1);
+    REQUIRE(c1->value == 0);
+    REQUIRE(c2->value == 1);
+}
@@ -0,0 +1,227 @@
+#include <catch.hpp>
+#include <hashed_indirect.h>
+
+#include <cstddef>
+#include <functional>
+#include <unordered_set>
+#include <utility>
+
+namespace
+{
+
+    class shape
+    {
+    public:
+        static size_t hash_count;
+
+        virtual ~shape() = default;
+        virtual int area() const = 0;
+        virtual void scale(int) = 0;
+
+        friend bool operator==(shape const& a, shape const& b) { return a.area() == b.area(); }
+        friend bool operator!=(shape const& a, shape const& b) { return a.area() != b.area(); }
+        friend bool operator<(shape const& a, shape const& b) { return a.area() < b.area(); }
+        friend bool operator<=(shape const& a, shape const& b) { return a.area() <= b.area(); }
+        friend bool operator>(shape const& a, shape const& b) { return a.area() > b.area(); }
+        friend bool operator>=(shape const& a, shape const& b) { return a.area() >= b.area(); }
+    };
+
+    size_t shape::hash_count = 0u;
+
+    class square : public shape
+    {
+    private:
+        int side;
+
+    public:
+        explicit square(int s) : side(s) {}
+        int area() const override { return side * side; }
+        void scale(int k) override { side *= k; }
+    };
+
+    class rectangle : public shape
+    {
+    private:
+        int w;
+        int h;
+
+    public:
+        rectangle(int w_, int h_) : w(w_), h(h_) {}
+        int area() const override { return w * h; }
+        void scale(int k) override { w *= k; }
+    };
+
+    // Hashes every shape with an area under 100 alike, so that equal hashes
+    // do not imply equal shapes.
+    struct coarse_hash
+    {
+        std::size_t operator()(shape const& s) const { return static_cast<std::size_t>(s.area() / 100); }
+    };
+
+} // namespace
+
+namespace std
+{
+
+    template <>
+    struct hash<shape>
+    {
+        std::size_t operator()(shape const& s) const
+        {
+            ++shape::hash_count;
+            return std::hash<int>()(s.area());
+        }
+    };
+
+} // namespace std
+
+SCENARIO("`hashed_indirect` computes the hash of its object once", "[hashed_indirect][hash]")
+{
+    shape::hash_count = 0;
+
+    GIVEN("a `hashed_indirect<shape>`")
+    {
+        hashed_indirect<shape> s{square{3}};
+
+        THEN("the hash is not computed until asked for")
+        {
+            REQUIRE(!s.hash_cached());
+            REQUIRE(shape::hash_count == 0);
+        }
+
+        WHEN("it is hashed repeatedly")
+        {
+            auto h = std::hash<hashed_indirect<shape>>()(s);
+            auto again = s.hash();
+
+            THEN("the object is hashed once")
+            {
+                REQUIRE(h == std::hash<int>()(9));
+                REQUIRE(again == h);
+                REQUIRE(shape::hash_count == 1);
+                REQUIRE(s.hash_cached());
+            }
+
+            THEN("a copy keeps the hash")
+            {
+                auto copy = s;
+                REQUIRE(copy.hash_cached());
+                REQUIRE(copy.hash() == h);
+                REQUIRE(shape::hash_count == 1);
+            }
+
+            THEN("a move takes the hash and leaves the source empty")
+            {
+                auto moved = std::move(s);
+                REQUIRE(moved.hash_cached());
+                REQUIRE(!s);
+                REQUIRE(!s.hash_cached());
+                REQUIRE(s.hash() == 0);
+            }
+
+            THEN("const access keeps the hash")
+            {
+                auto const& c = s;
+                REQUIRE(c->area() == 9);
+                REQUIRE((*c).area() == 9);
+                REQUIRE(s.hash_cached());
+            }
+
+            THEN("non-const access forgets it")
+            {
+                s->scale(2);
+                REQUIRE(!s.hash_cached());
+                REQUIRE(s.hash() == std::hash<int>()(36));
+                REQUIRE(shape::hash_count == 2);
+            }
+
+            THEN("assigning or emplacing an object forgets it")
+            {
+                s = square{4};
+                REQUIRE(!s.hash_cached());
+                s.hash();
+                s.emplace<rectangle>(2, 3);
+                REQUIRE(!s.hash_cached());
+                REQUIRE(s.hash() == std::hash<int>()(6));
+            }
+
+            THEN("releasing the `indirect` empties it")
+            {
+                indirect<shape> i = s.release();
+                REQUIRE(i->area() == 9);
+                REQUIRE(!s);
+                REQUIRE(!s.hash_cached());
+            }
+        }
+    }
+
+    GIVEN("`hashed_indirect`s with a hash that collides")
+    {
+        using coarse = hashed_indirect<shape, heap_storage, coarse_hash>;
+        coarse a{square{2}};
+        coarse b{rectangle{2, 2}};
+        coarse c{square{5}};
+        coarse d{rectangle{1, 200}};
+
+        THEN("they compare by their objects")
+        {
+            REQUIRE(a.hash() == c.hash());
+            REQUIRE(a == b);
+            REQUIRE(a != c);
+            REQUIRE(a < c);
+            REQUIRE(c > b);
+            REQUIRE(b <= a);
+            REQUIRE(a >= b);
+        }
+
+        THEN("shapes with different known hashes compare unequal")
+        {
+            REQUIRE(a.hash() != d.hash());
+            REQUIRE(a != d);
+        }
+    }
+}
+
+SCENARIO("`hashed_indirect`s are keys of hash containers", "[hashed_indirect][hash][container]")
+{
+    shape::hash_count = 0;
+
+    GIVEN("an `unordered_set` of `hashed_indirect<shape>`")
+    {
+        std::unordered_set<hashed_indirect<shape>> set;
+        for (int i = 1; i <= 100; ++i)
+        {
+            set.insert(hashed_indirect<shape>(square{i}));
+        }
+        REQUIRE(shape::hash_count == 100);
+
+        WHEN("it is rehashed")
+        {
+            set.rehash(set.bucket_count() * 4);
+
+            THEN("no object is hashed again")
+            {
+                REQUIRE(shape::hash_count == 100);
+            }
+        }
+
+        WHEN("a key is looked up repeatedly")
+        {
+            hashed_indirect<shape> key{rectangle{5, 5}};
+            for (int i = 0; i < 10; ++i)
+            {
+                REQUIRE(set.count(key) == 1);
+            }
+
+            THEN("it is hashed once")
+            {
+                REQUIRE(shape::hash_count == 101);
+            }
+        }
+
+        THEN("a key that is not present is not found")
+        {
+            REQUIRE(set.count(hashed_indirect<shape>(rectangle{2, 3})) == 0);
+        }
+    }
+}
@@ -1,6 +1,11 @@
 #include <catch.hpp>
 #include <indirect.h>
 
+#include <new>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
 class base
 {
 public:
@@ -154,8 +159,8 @@ SCENARIO("`indirect` can be move constructed", "[construct][move]")
         {
             indirect<derived> d2{std::move(d1)};
 
-            REQUIRE(derived::object_count == 2);
-            REQUIRE(d1->get_value() == 0);
+            REQUIRE(derived::object_count == 1);
+            REQUIRE(!d1);
             REQUIRE(d2->get_value() == 42);
         }
 
@@ -163,8 +168,8 @@ SCENARIO("`indirect` can be move constructed", "[construct][move]")
         {
             indirect<base> b2{std::move(d1)};
 
-            REQUIRE(derived::object_count == 2);
-            REQUIRE(d1->get_value() == 0);
+            REQUIRE(derived::object_count == 1);
+            REQUIRE(!d1);
             REQUIRE(b2->get_value() == 42);
         }
     }
@@ -177,8 +182,8 @@ SCENARIO("`indirect` can be move constructed", "[construct][move]")
         {
             indirect<base> b2{std::move(b1)};
 
-            REQUIRE(derived::object_count == 2);
-            REQUIRE(b1->get_value() == 0);
+            REQUIRE(derived::object_count == 1);
+            REQUIRE(!b1);
             REQUIRE(b2->get_value() == 42);
         }
     }
@@ -195,8 +200,8 @@ SCENARIO("`indirect` can be move assigned", "[assign][move]")
             indirect<derived> d2;
             d2 = std::move(d1);
 
-            REQUIRE(derived::object_count == 2);
-            REQUIRE(d1->get_value() == 0);
+            REQUIRE(derived::object_count == 1);
+            REQUIRE(!d1);
             REQUIRE(d2->get_value() == 42);
         }
 
@@ -205,8 +210,8 @@ SCENARIO("`indirect` can be move assigned", "[assign][move]")
             indirect<base> b2{indirect<derived>{}};
             b2 = std::move(d1);
 
-            REQUIRE(derived::object_count == 2);
-            REQUIRE(d1->get_value() == 0);
+            REQUIRE(derived::object_count == 1);
+            REQUIRE(!d1);
             REQUIRE(b2->get_value() == 42);
         }
     }
@@ -220,8 +225,8 @@ SCENARIO("`indirect` can be move assigned", "[assign][move]")
             indirect<base> b2{indirect<derived>{}};
             b2 = std::move(b1);
 
-            REQUIRE(derived::object_count == 2);
-            REQUIRE(b1->get_value() == 0);
+            REQUIRE(derived::object_count == 1);
+            REQUIRE(!b1);
             REQUIRE(b2->get_value() == 42);
         }
     }
@@ -380,13 +385,41 @@ SCENARIO("`indirect` can be cast", "[cast]")
 
         WHEN("it is static cast moved to `indirect<derived>`")
         {
+            auto p = &*b1;
             auto d2 = static_indirect_cast<derived>(std::move(b1));
 
-            REQUIRE(derived::object_count == 2);
-            REQUIRE(b1->get_value() == 0);
+            REQUIRE(derived::object_count == 1);
+            REQUIRE(!b1);
+            REQUIRE(&*d2 == p);
+            REQUIRE(d2->get_value() == 42);
+        }
+
+        WHEN("it is dynamic cast moved to `indirect<derived>`")
+        {
+            auto p = &*b1;
+            auto d2 = dynamic_indirect_cast<derived>(std::move(b1));
+
+            REQUIRE(derived::object_count == 1);
+            REQUIRE(!b1);
+            REQUIRE(&*d2 == p);
             REQUIRE(d2->get_value() == 42);
         }
 
+        WHEN("it is viewed as a `derived`")
+        {
+            auto v1 = static_indirect_cast_view<derived>(b1);
+            auto v2 = dynamic_indirect_cast_view<derived>(b1);
+
+            REQUIRE(derived::object_count == 1);
+            REQUIRE(v1.get() == &*b1);
+            REQUIRE(v2->get_value() == 42);
+        }
+
+        WHEN("it is viewed as a `derived_other`")
+        {
+            REQUIRE(!dynamic_indirect_cast_view<derived_other>(b1));
+        }
+
         WHEN("it is dynamic cast copied to `indirect<derived>`")
         {
             auto d2 = dynamic_indirect_cast<derived>(b1);
@@ -398,7 +431,7 @@ SCENARIO("`indirect` can be cast", "[cast]")
 
         WHEN("it is dynamic cast copied to `indirect<derived_other>`")
         {
-            REQUIRE_THROWS(auto d2 = dynamic_indirect_cast<derived_other>(b1));
+            REQUIRE_THROWS(dynamic_indirect_cast<derived_other>(b1));
 
             REQUIRE(derived::object_count == 1);
             REQUIRE(b1->get_value() == 42);
@@ -406,7 +439,7 @@ SCENARIO("`indirect` can be cast", "[cast]")
 
         WHEN("it is dynamic cast moved back to `indirect<derived_other>`")
         {
-            REQUIRE_THROWS(auto d2 = dynamic_indirect_cast<derived_other>(std::move(b1)));
+            REQUIRE_THROWS(dynamic_indirect_cast<derived_other>(std::move(b1)));
 
             REQUIRE(derived::object_count == 1);
             REQUIRE(b1->get_value() == 42);
@@ -430,9 +463,1117 @@ SCENARIO("`indirect` can be cast", "[cast]")
         {
             indirect<derived> d2 = std::move(b1);
 
+            REQUIRE(derived::object_count == 1);
+            REQUIRE(!b1);
+            REQUIRE(d2->get_value() == 42);
+        }
+    }
+}
+
+SCENARIO("`indirect` moves transfer ownership without copying", "[move][noexcept]")
+{
+    static_assert(std::is_nothrow_move_constructible<indirect<base>>::value, "");
+    static_assert(std::is_nothrow_move_assignable<indirect<base>>::value, "");
+    static_assert(std::is_nothrow_constructible<indirect<base>, indirect<derived>&&>::value, "");
+
+    GIVEN("an `indirect<derived>`")
+    {
+        indirect<derived> d1{in_place, 42};
+        derived const* p = &*d1;
+
+        WHEN("it is moved into an `indirect<base>`")
+        {
+            indirect<base> b2{std::move(d1)};
+
+            REQUIRE(derived::object_count == 1);
+            REQUIRE(&*b2 == p);
+        }
+
+        WHEN("the moved-from `indirect` is copied and assigned to")
+        {
+            indirect<derived> d2{std::move(d1)};
+            indirect<derived> d3{d1};
+
+            REQUIRE(!d3);
+
+            d1 = d2;
+
             REQUIRE(derived::object_count == 2);
-            REQUIRE(b1->get_value() == 0);
+            REQUIRE(d1->get_value() == 42);
+        }
+    }
+
+    GIVEN("a vector of `indirect<base>`")
+    {
+        std::vector<indirect<base>> v;
+        v.emplace_back(make_indirect<derived>(1));
+        base const* p = &*v.front();
+
+        WHEN("the vector grows")
+        {
+            v.reserve(v.capacity() + 1);
+
+            REQUIRE(derived::object_count == 1);
+            REQUIRE(&*v.front() == p);
+        }
+    }
+}
+
+template <typename T, typename S>
+bool is_stored_inline(indirect<T, S> const& i)
+{
+    auto p = reinterpret_cast<char const*>(&*i);
+    auto begin = reinterpret_cast<char const*>(&i);
+    return p >= begin && p < begin + sizeof(i);
+}
+
+SCENARIO("`indirect` can store small objects inline", "[construct][inline]")
+{
+    using small_storage = inline_storage<4 * sizeof(void*)>;
+
+    static_assert(sizeof(indirect<base>) == 2 * sizeof(void*), "");
+    static_assert(is_inline_storable<derived_other, small_storage>::value, "");
+    static_assert(!is_inline_storable<derived, small_storage>::value, "`derived` has a throwing move");
+    static_assert(!is_inline_storable<derived_other, heap_storage>::value, "");
+
+    GIVEN("an inline `indirect<base>` holding a `derived_other`")
+    {
+        indirect<base, small_storage> b1{derived_other{}};
+        b1->set_value(42);
+
+        REQUIRE(is_stored_inline(b1));
+
+        WHEN("it is copied")
+        {
+            indirect<base, small_storage> b2{b1};
+            b2->set_value(7);
+
+            REQUIRE(is_stored_inline(b2));
+            REQUIRE(b1->get_value() == 42);
+            REQUIRE(b2->get_value() == 7);
+        }
+
+        WHEN("it is moved")
+        {
+            indirect<base, small_storage> b2{std::move(b1)};
+
+            REQUIRE(!b1);
+            REQUIRE(is_stored_inline(b2));
+            REQUIRE(b2->get_value() == 42);
+        }
+
+        WHEN("it is swapped with an `indirect<base>` stored on the free store")
+        {
+            indirect<base, small_storage> b2{derived{7}};
+
+            REQUIRE(!is_stored_inline(b2));
+
+            swap(b1, b2);
+
+            REQUIRE(derived::object_count == 1);
+            REQUIRE(!is_stored_inline(b1));
+            REQUIRE(is_stored_inline(b2));
+            REQUIRE(b1->get_value() == 7);
+            REQUIRE(b2->get_value() == 42);
+        }
+
+        WHEN("it is cast to `indirect<derived_other>`")
+        {
+            auto d2 = dynamic_indirect_cast<derived_other>(b1);
+
+            REQUIRE(is_stored_inline(d2));
+            REQUIRE(d2->get_value() == 42);
+        }
+
+        WHEN("it is cast moved to `indirect<derived_other>`")
+        {
+            auto d2 = dynamic_indirect_cast<derived_other>(std::move(b1));
+
+            REQUIRE(!b1);
+            REQUIRE(is_stored_inline(d2));
             REQUIRE(d2->get_value() == 42);
         }
+
+        WHEN("it is cast to `indirect<derived_other>` and moved back")
+        {
+            auto d2 = dynamic_indirect_cast<derived_other>(b1);
+            b1 = std::move(d2);
+
+            REQUIRE(!d2);
+            REQUIRE(is_stored_inline(b1));
+            REQUIRE(b1->get_value() == 42);
+        }
+    }
+
+    GIVEN("an inline `indirect<derived_other>`")
+    {
+        indirect<derived_other, small_storage> d1{derived_other{}};
+        d1->set_value(42);
+
+        WHEN("it is moved into an `indirect<base>`")
+        {
+            indirect<base, small_storage> b2{std::move(d1)};
+
+            REQUIRE(!d1);
+            REQUIRE(is_stored_inline(b2));
+            REQUIRE(b2->get_value() == 42);
+        }
+
+        WHEN("it is move-assigned to an `indirect<base>`")
+        {
+            indirect<base, small_storage> b2{derived{7}};
+            b2 = std::move(d1);
+
+            REQUIRE(!d1);
+            REQUIRE(derived::object_count == 0);
+            REQUIRE(is_stored_inline(b2));
+            REQUIRE(b2->get_value() == 42);
+        }
+    }
+
+    GIVEN("an `indirect<base>` with inline storage holding a `derived`")
+    {
+        indirect<base, small_storage> b1{derived{42}};
+        base const* p = &*b1;
+
+        WHEN("it is moved")
+        {
+            indirect<base, small_storage> b2{std::move(b1)};
+
+            REQUIRE(derived::object_count == 1);
+            REQUIRE(&*b2 == p);
+        }
+    }
+}
+
+struct allocation_counts
+{
+    size_t allocations = 0;
+    size_t deallocations = 0;
+};
+
+template <typename T>
+class counting_allocator
+{
+    template <typename>
+    friend class counting_allocator;
+
+private:
+    allocation_counts* counts;
+
+public:
+    using value_type = T;
+
+    explicit counting_allocator(allocation_counts& c) noexcept : counts(&c) {}
+
+    template <typename U>
+    counting_allocator(counting_allocator<U> const& other) noexcept : counts(other.counts) {}
+
+    T* allocate(size_t n)
+    {
+        ++counts->allocations;
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        ++counts->deallocations;
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(counting_allocator<U> const& other) const noexcept { return counts == other.counts; }
+
+    template <typename U>
+    bool operator!=(counting_allocator<U> const& other) const noexcept { return counts != other.counts; }
+};
+
+SCENARIO("`indirect` can be constructed with an allocator", "[construct][allocator]")
+{
+    allocation_counts counts;
+    counting_allocator<derived> alloc{counts};
+
+    GIVEN("an `indirect<base>` created by `allocate_indirect`")
+    {
+        indirect<base> b1 = allocate_indirect<derived>(alloc, 42);
+
+        REQUIRE(derived::object_count == 1);
+        REQUIRE(counts.allocations == 1);
+        REQUIRE(b1->get_value() == 42);
+
+        WHEN("it is copied")
+        {
+            indirect<base> b2{b1};
+
+            THEN("the copy is allocated by the same allocator")
+            {
+                REQUIRE(derived::object_count == 2);
+                REQUIRE(counts.allocations == 2);
+                REQUIRE(b2->get_value() == 42);
+            }
+        }
+
+        WHEN("it is moved")
+        {
+            indirect<base> b2{std::move(b1)};
+
+            REQUIRE(counts.allocations == 1);
+            REQUIRE(b2->get_value() == 42);
+        }
+
+        WHEN("it is destroyed")
+        {
+            {
+                indirect<base> b2{std::move(b1)};
+            }
+
+            REQUIRE(derived::object_count == 0);
+            REQUIRE(counts.deallocations == 1);
+        }
+    }
+
+    GIVEN("an `indirect<derived>` constructed with `std::allocator_arg`")
+    {
+        indirect<derived> d1{std::allocator_arg, alloc, in_place, 42};
+
+        REQUIRE(counts.allocations == 1);
+        REQUIRE(d1->get_value() == 42);
+    }
+
+    GIVEN("an inline `indirect<derived_other>` constructed with an allocator")
+    {
+        indirect<derived_other, inline_storage<4 * sizeof(void*)>> d1{
+            std::allocator_arg, counting_allocator<derived_other>{counts}, in_place};
+        indirect<base, inline_storage<4 * sizeof(void*)>> b1{d1};
+
+        THEN("no allocation is made")
+        {
+            REQUIRE(counts.allocations == 0);
+        }
+    }
+
+    REQUIRE(counts.allocations == counts.deallocations);
+}
+
+#ifdef INDIRECT_HAS_PMR
+class counting_resource : public std::pmr::memory_resource
+{
+public:
+    size_t allocations = 0;
+    size_t deallocations = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        ++allocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        ++deallocations;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+class default_resource_guard
+{
+private:
+    std::pmr::memory_resource* previous;
+
+public:
+    explicit default_resource_guard(std::pmr::memory_resource* r) : previous(std::pmr::set_default_resource(r)) {}
+    ~default_resource_guard() { std::pmr::set_default_resource(previous); }
+};
+
+SCENARIO("`pmr::indirect` allocates from a memory resource", "[construct][allocator][pmr]")
+{
+    counting_resource default_resource;
+    counting_resource r1;
+    counting_resource r2;
+
+    {
+        default_resource_guard guard{&default_resource};
+
+        GIVEN("a `pmr::indirect<base>` using a memory resource")
+        {
+            pmr::indirect<base> b1{std::allocator_arg, &r1, derived{42}};
+
+            REQUIRE(r1.allocations == 1);
+            REQUIRE(b1->get_value() == 42);
+
+            WHEN("it is copy constructed")
+            {
+                pmr::indirect<base> b2{b1};
+
+                THEN("the copy uses the default resource")
+                {
+                    REQUIRE(r1.allocations == 1);
+                    REQUIRE(default_resource.allocations == 1);
+                    REQUIRE(b2->get_value() == 42);
+                }
+            }
+
+            WHEN("it is copy constructed with another resource")
+            {
+                pmr::indirect<base> b2{std::allocator_arg, &r2, b1};
+
+                REQUIRE(r1.allocations == 1);
+                REQUIRE(r2.allocations == 1);
+                REQUIRE(b2->get_value() == 42);
+            }
+
+            WHEN("it is copy assigned to a `pmr::indirect` using another resource")
+            {
+                pmr::indirect<base> b2{std::allocator_arg, &r2, derived{7}};
+                b2 = b1;
+
+                THEN("the copy uses the destination's resource")
+                {
+                    REQUIRE(r1.allocations == 1);
+                    REQUIRE(r2.allocations == 2);
+                    REQUIRE(r2.deallocations == 1);
+                    REQUIRE(b2->get_value() == 42);
+                }
+            }
+
+            WHEN("it is move constructed")
+            {
+                base const* p = &*b1;
+                pmr::indirect<base> b2{std::move(b1)};
+
+                REQUIRE(!b1);
+                REQUIRE(r1.allocations == 1);
+                REQUIRE(default_resource.allocations == 0);
+                REQUIRE(&*b2 == p);
+                REQUIRE(b2->get_value() == 42);
+            }
+
+            WHEN("it is swapped with a `pmr::indirect` using the same resource")
+            {
+                pmr::indirect<base> b2{std::allocator_arg, &r1, derived{7}};
+                base const* p1 = &*b1;
+                base const* p2 = &*b2;
+                swap(b1, b2);
+
+                THEN("the objects are exchanged without allocating")
+                {
+                    REQUIRE(r1.allocations == 2);
+                    REQUIRE(default_resource.allocations == 0);
+                    REQUIRE(&*b1 == p2);
+                    REQUIRE(&*b2 == p1);
+                }
+            }
+
+            WHEN("it is swapped with a `pmr::indirect` using another resource")
+            {
+                pmr::indirect<base> b2{std::allocator_arg, &r2, derived{7}};
+                swap(b1, b2);
+
+                THEN("each keeps its resource")
+                {
+                    REQUIRE(r1.allocations == 2);
+                    REQUIRE(r2.allocations == 2);
+                    REQUIRE(default_resource.allocations == 0);
+                    REQUIRE(b1->get_value() == 7);
+                    REQUIRE(b2->get_value() == 42);
+                }
+            }
+
+            WHEN("it is move assigned to a `pmr::indirect` using another resource")
+            {
+                pmr::indirect<base> b2{std::allocator_arg, &r2, derived{7}};
+                b2 = std::move(b1);
+
+                THEN("the object is moved into the destination's resource")
+                {
+                    REQUIRE(!b1);
+                    REQUIRE(derived::object_count == 1);
+                    REQUIRE(r1.deallocations == 1);
+                    REQUIRE(r2.allocations == 2);
+                    REQUIRE(b2->get_value() == 42);
+                }
+            }
+
+            WHEN("it is copied into a pmr container")
+            {
+                std::pmr::vector<pmr::indirect<base>> v{&r2};
+                v.reserve(2);
+                v.push_back(b1);
+                v.emplace_back(derived{7});
+
+                THEN("the elements use the container's resource")
+                {
+                    REQUIRE(r2.allocations == 3);
+                    REQUIRE(default_resource.allocations == 0);
+                    REQUIRE(v[0]->get_value() == 42);
+                    REQUIRE(v[1]->get_value() == 7);
+                }
+            }
+        }
+    }
+
+    REQUIRE(r1.allocations == r1.deallocations);
+    REQUIRE(r2.allocations == r2.deallocations);
+    REQUIRE(default_resource.allocations == default_resource.deallocations);
+}
+#endif
+
+class derived_final final : public base
+{
+private:
+    int value = 0;
+
+public:
+    int get_value() const override { return value; }
+    void set_value(int i) override { value = i; }
+};
+
+SCENARIO("`indirect` of a final type can be copied", "[construct][copy][final]")
+{
+    GIVEN("an `indirect<derived_final>`")
+    {
+        indirect<derived_final> d1;
+        d1->set_value(42);
+
+        WHEN("it is copied")
+        {
+            indirect<derived_final> d2{d1};
+            d2->set_value(7);
+
+            REQUIRE(d1->get_value() == 42);
+            REQUIRE(d2->get_value() == 7);
+        }
+
+        WHEN("it is copied into an `indirect<base>`")
+        {
+            indirect<base> b2{d1};
+
+            REQUIRE(b2->get_value() == 42);
+        }
+    }
+
+    GIVEN("an `indirect<derived_final>` constructed with an allocator")
+    {
+        allocation_counts counts;
+
+        {
+            indirect<derived_final> d1{std::allocator_arg, counting_allocator<derived_final>{counts}, in_place};
+
+            WHEN("it is copied")
+            {
+                indirect<derived_final> d2{d1};
+
+                THEN("the copy is still allocated by the allocator")
+                {
+                    REQUIRE(counts.allocations == 2);
+                }
+            }
+        }
+
+        REQUIRE(counts.allocations == counts.deallocations);
+    }
+}
+
+SCENARIO("`indirect<T, exact_type>` holds exactly a `T`", "[construct][copy][exact]")
+{
+    GIVEN("an `indirect<derived, exact_type>`")
+    {
+        indirect<derived, exact_type> d1{in_place, 42};
+
+        REQUIRE(sizeof(d1) == sizeof(derived*));
+
+        WHEN("it is copied")
+        {
+            indirect<derived, exact_type> d2{d1};
+            d2->set_value(7);
+
+            REQUIRE(derived::object_count == 2);
+            REQUIRE(d1->get_value() == 42);
+            REQUIRE(d2->get_value() == 7);
+        }
+
+        WHEN("it is moved")
+        {
+            auto* p = &*d1;
+            indirect<derived, exact_type> d2{std::move(d1)};
+
+            REQUIRE(!d1);
+            REQUIRE(&*d2 == p);
+            REQUIRE(derived::object_count == 1);
+        }
+
+        WHEN("it is assigned to")
+        {
+            indirect<derived, exact_type> d2{derived{1}};
+            d2 = d1;
+            d1 = derived{3};
+
+            REQUIRE(derived::object_count == 2);
+            REQUIRE(d1->get_value() == 3);
+            REQUIRE(d2->get_value() == 42);
+        }
+    }
+
+    REQUIRE(derived::object_count == 0);
+}
+
+class plain
+{
+public:
+    virtual ~plain() = default;
+    virtual int who() const { return 1; }
+};
+
+class plain_derived : public plain
+{
+public:
+    int who() const override { return 2; }
+};
+
+static_assert(std::is_constructible<indirect<plain, exact_type>, plain const&>::value, "");
+static_assert(std::is_convertible<plain, indirect<plain, exact_type>>::value, "");
+static_assert(!std::is_constructible<indirect<plain, exact_type>, plain_derived>::value, "exact `indirect` does not slice");
+static_assert(!std::is_constructible<indirect<plain, exact_type>, plain_derived const&>::value, "");
+static_assert(!std::is_convertible<plain_derived, indirect<plain, exact_type>>::value, "");
+static_assert(!std::is_assignable<indirect<plain, exact_type>&, plain_derived&>::value, "");
+
+static_assert(is_trivially_relocatable<indirect<base>>::value, "heap `indirect` is trivially relocatable");
+static_assert(is_trivially_relocatable<indirect<derived, exact_type>>::value, "exact `indirect` is trivially relocatable");
+static_assert(!is_trivially_relocatable<indirect<base, inline_storage<32>>>::value, "inline `indirect` is not");
+
+SCENARIO("`indirect` arrays can be relocated", "[relocate]")
+{
+    GIVEN("an array of `indirect<base>` relocated to new storage")
+    {
+        alignas(indirect<base>) unsigned char source[4 * sizeof(indirect<base>)];
+        alignas(indirect<base>) unsigned char dest[4 * sizeof(indirect<base>)];
+        auto first = reinterpret_cast<indirect<base>*>(source);
+        for (int i = 0; i < 4; ++i)
+        {
+            ::new (static_cast<void*>(first + i)) indirect<base>(derived(i));
+        }
+        auto d_first = reinterpret_cast<indirect<base>*>(dest);
+        auto d_last = uninitialized_relocate(first, first + 4, d_first);
+
+        REQUIRE(derived::object_count == 4);
+        REQUIRE(d_first[3]->get_value() == 3);
+
+        WHEN("an element is erased by relocating the elements after it")
+        {
+            d_first[1].~indirect<base>();
+            d_last = uninitialized_relocate(d_first + 2, d_last, d_first + 1);
+
+            REQUIRE(d_last - d_first == 3);
+            REQUIRE(derived::object_count == 3);
+            REQUIRE(d_first[1]->get_value() == 2);
+            REQUIRE(d_first[2]->get_value() == 3);
+        }
+
+        for (auto p = d_first; p != d_last; ++p)
+        {
+            p->~indirect<base>();
+        }
+    }
+
+    GIVEN("an `indirect` with inline storage relocated to new storage")
+    {
+        using small_indirect = indirect<base, inline_storage<4 * sizeof(void*)>>;
+        alignas(small_indirect) unsigned char source[sizeof(small_indirect)];
+        alignas(small_indirect) unsigned char dest[sizeof(small_indirect)];
+        auto i1 = ::new (static_cast<void*>(source)) small_indirect(derived_other());
+        (*i1)->set_value(42);
+        auto i2 = relocate_at(i1, reinterpret_cast<small_indirect*>(dest));
+
+        THEN("it is moved and its object is in its new storage")
+        {
+            REQUIRE(is_stored_inline(*i2));
+            REQUIRE((*i2)->get_value() == 42);
+        }
+
+        i2->~small_indirect();
+    }
+
+    REQUIRE(derived::object_count == 0);
+}
+
+class out_of_memory : public base
+{
+public:
+    out_of_memory() = default;
+    out_of_memory(out_of_memory const&) { throw std::bad_alloc(); }
+    out_of_memory(out_of_memory&&) {}
+    int get_value() const override { return -1; }
+    void set_value(int) override {}
+};
+
+SCENARIO("`try_` functions report failure with an empty `indirect`", "[try]")
+{
+    GIVEN("an `indirect<base>` holding a `derived`")
+    {
+        indirect<base> b1 = try_make_indirect<derived>(42);
+
+        REQUIRE(b1);
+        REQUIRE(b1->get_value() == 42);
+
+        THEN("it can be copied and dynamic cast to `derived`")
+        {
+            auto b2 = try_copy(b1);
+            auto d1 = try_dynamic_indirect_cast<derived>(b1);
+
+            REQUIRE(derived::object_count == 3);
+            REQUIRE(b2->get_value() == 42);
+            REQUIRE(d1->get_value() == 42);
+        }
+
+        THEN("a dynamic cast to `derived_other` is empty")
+        {
+            REQUIRE(!try_dynamic_indirect_cast<derived_other>(b1));
+            REQUIRE(!try_dynamic_indirect_cast<derived_other>(std::move(b1)));
+            REQUIRE(b1->get_value() == 42);
+        }
+    }
+
+    GIVEN("an `indirect<base>` whose copy runs out of memory")
+    {
+        indirect<base> b1{out_of_memory{}};
+
+        THEN("`try_copy` returns an empty `indirect`")
+        {
+            REQUIRE(!try_copy(b1));
+            REQUIRE(!try_dynamic_indirect_cast<out_of_memory>(b1));
+        }
+    }
+
+    GIVEN("an empty `indirect`")
+    {
+        indirect<base> b1 = make_indirect<derived>(42);
+        auto b2 = std::move(b1);
+
+        THEN("its copy is empty")
+        {
+            REQUIRE(!try_copy(b1));
+        }
+    }
+
+    GIVEN("an `indirect<derived, exact_type>`")
+    {
+        indirect<derived, exact_type> e1{in_place, 42};
+
+        THEN("it can be copied")
+        {
+            auto e2 = try_copy(e1);
+
+            REQUIRE(derived::object_count == 2);
+            REQUIRE(e2->get_value() == 42);
+        }
+    }
+
+    REQUIRE(derived::object_count == 0);
+}
+
+class virtual_base
+{
+public:
+    virtual ~virtual_base() = default;
+    int value = 0;
+};
+
+class virtually_derived : public virtual virtual_base
+{
+};
+
+SCENARIO("`indirect` can be cast to the exact type of its object", "[cast][exact]")
+{
+    GIVEN("an `indirect<base>` holding a `derived`")
+    {
+        indirect<base> b1 = make_indirect<derived>(42);
+
+        REQUIRE(b1.holds_type<derived>());
+        REQUIRE(b1.holds_type<derived const>());
+        REQUIRE(!b1.holds_type<base>());
+        REQUIRE(!b1.holds_type<derived_other>());
+
+        WHEN("it is exact cast copied to `indirect<derived>`")
+        {
+            auto d2 = exact_indirect_cast<derived>(b1);
+
+            REQUIRE(derived::object_count == 2);
+            REQUIRE(d2.holds_type<derived>());
+            REQUIRE(d2->get_value() == 42);
+        }
+
+        WHEN("it is exact cast moved to `indirect<derived>`")
+        {
+            auto p = &*b1;
+            auto d2 = exact_indirect_cast<derived>(std::move(b1));
+
+            REQUIRE(!b1);
+            REQUIRE(&*d2 == p);
+        }
+
+        WHEN("it is exact cast to another type")
+        {
+            REQUIRE_THROWS_AS(exact_indirect_cast<derived_other>(b1), bad_indirect_cast);
+            REQUIRE_THROWS_AS(exact_indirect_cast<base>(std::move(b1)), bad_indirect_cast);
+            REQUIRE(b1->get_value() == 42);
+        }
+
+        WHEN("it is viewed as its exact type")
+        {
+            REQUIRE(exact_indirect_cast_view<derived>(b1).get() == &*b1);
+            REQUIRE(!exact_indirect_cast_view<derived_other>(b1));
+        }
+    }
+
+    GIVEN("an inline `indirect<base>` holding a `derived_other`")
+    {
+        indirect<base, inline_storage<4 * sizeof(void*)>> b1{derived_other{}};
+
+        REQUIRE(b1.holds_type<derived_other>());
+        REQUIRE(exact_indirect_cast<derived_other>(b1).holds_type<derived_other>());
+    }
+
+    GIVEN("an `indirect` of a virtual base")
+    {
+        indirect<virtual_base> v1{virtually_derived{}};
+        v1->value = 7;
+
+        REQUIRE(exact_indirect_cast_view<virtually_derived>(v1)->value == 7);
+        REQUIRE(exact_indirect_cast<virtually_derived>(v1)->value == 7);
+    }
+
+    GIVEN("an empty `indirect`")
+    {
+        indirect<base> b1 = make_indirect<derived>(42);
+        auto b2 = std::move(b1);
+
+        REQUIRE(!b1.holds_type<derived>());
+    }
+
+    REQUIRE(derived::object_count == 0);
+}
+
+class throwing_assignment : public base
+{
+private:
+    int value = 0;
+
+public:
+    throwing_assignment() = default;
+    throwing_assignment(throwing_assignment const&) = default;
+    throwing_assignment& operator=(throwing_assignment const& other) noexcept(false)
+    {
+        value = other.value;
+        return *this;
+    }
+    int get_value() const override { return value; }
+    void set_value(int i) override { value = i; }
+};
+
+SCENARIO("`indirect` copy assignment reuses the object of the same type", "[assign][copy]")
+{
+    GIVEN("two `indirect<base>` holding a `derived_other`")
+    {
+        indirect<base> b1{derived_other{}};
+        indirect<base> b2{derived_other{}};
+        b1->set_value(42);
+        auto p = &*b2;
+
+        WHEN("one is copy assigned to the other")
+        {
+            b2 = b1;
+
+            THEN("the object is assigned in place")
+            {
+                REQUIRE(&*b2 == p);
+                REQUIRE(b2->get_value() == 42);
+                REQUIRE(b1->get_value() == 42);
+            }
+        }
+
+        WHEN("an `indirect<derived_other>` is assigned to one")
+        {
+            indirect<derived_other> d;
+            d->set_value(3);
+            b2 = d;
+
+            THEN("the object is assigned in place")
+            {
+                REQUIRE(&*b2 == p);
+                REQUIRE(b2->get_value() == 3);
+            }
+        }
+
+        WHEN("an `indirect<base>` holding another type is assigned to one")
+        {
+            indirect<base> d = make_indirect<derived>(3);
+            b2 = d;
+
+            THEN("a new object is copied")
+            {
+                REQUIRE(derived::object_count == 2);
+                REQUIRE(&*b2 != p);
+                REQUIRE(b2->get_value() == 3);
+            }
+        }
+    }
+
+    GIVEN("two inline `indirect<base>` holding a `derived_other`")
+    {
+        indirect<base, inline_storage<4 * sizeof(void*)>> b1{derived_other{}};
+        indirect<base, inline_storage<4 * sizeof(void*)>> b2{derived_other{}};
+        b1->set_value(42);
+        b2 = b1;
+
+        REQUIRE(is_stored_inline(b2));
+        REQUIRE(b2->get_value() == 42);
+    }
+
+    GIVEN("two `indirect<base>` holding a type whose copy assignment may throw")
+    {
+        indirect<base> b1{throwing_assignment{}};
+        indirect<base> b2{throwing_assignment{}};
+        b1->set_value(42);
+        auto p = &*b2;
+        b2 = b1;
+
+        THEN("a new object is copied")
+        {
+            REQUIRE(&*b2 != p);
+            REQUIRE(b2->get_value() == 42);
+        }
+    }
+
+    GIVEN("two `indirect<derived_other, exact_type>`")
+    {
+        indirect<derived_other, exact_type> e1;
+        indirect<derived_other, exact_type> e2;
+        e1->set_value(42);
+        auto p = &*e2;
+        e2 = e1;
+
+        REQUIRE(&*e2 == p);
+        REQUIRE(e2->get_value() == 42);
+    }
+
+    REQUIRE(derived::object_count == 0);
+}
+
+SCENARIO("`indirect` objects can be replaced in place", "[emplace]")
+{
+    GIVEN("an `indirect<base>` holding a `derived`")
+    {
+        indirect<base> b = make_indirect<derived>(7);
+        auto p = static_cast<void const*>(&*b);
+
+        WHEN("a `derived` is emplaced")
+        {
+            auto& d = b.emplace<derived>(42);
+
+            THEN("it is constructed in the memory of the old one")
+            {
+                REQUIRE(derived::object_count == 1);
+                REQUIRE(static_cast<void const*>(&d) == p);
+                REQUIRE(b->get_value() == 42);
+                REQUIRE(b.holds_type<derived>());
+            }
+        }
+
+        WHEN("an object of another type of the same size is emplaced")
+        {
+            static_assert(sizeof(derived_final) == sizeof(derived), "the types must be the same size");
+            b.emplace<derived_final>();
+
+            THEN("it reuses the memory of the old one")
+            {
+                REQUIRE(derived::object_count == 0);
+                REQUIRE(static_cast<void const*>(&*b) == p);
+                REQUIRE(b.holds_type<derived_final>());
+            }
+        }
+    }
+
+    GIVEN("an `indirect<base>` whose emplaced object throws")
+    {
+        indirect<base> b{out_of_memory{}};
+        out_of_memory o;
+
+        REQUIRE_THROWS_AS(b.emplace<out_of_memory>(o), std::bad_alloc);
+        REQUIRE(!b);
+
+        WHEN("another object is emplaced")
+        {
+            b.emplace<derived>(3);
+
+            REQUIRE(b->get_value() == 3);
+        }
+    }
+
+    GIVEN("an inline `indirect<base>` holding a `derived_other`")
+    {
+        indirect<base, inline_storage<4 * sizeof(void*)>> b{derived_other{}};
+        b.emplace<derived_other>().set_value(42);
+
+        REQUIRE(is_stored_inline(b));
+        REQUIRE(b->get_value() == 42);
+
+        WHEN("a type that is not stored inline is emplaced")
+        {
+            b.emplace<derived>(7);
+
+            REQUIRE(!is_stored_inline(b));
+            REQUIRE(b->get_value() == 7);
+        }
+    }
+
+    REQUIRE(derived::object_count == 0);
+}
+
+struct message
+{
+    int id;
+    double payload[3];
+};
+
+SCENARIO("`indirect` of a trivially copyable type copies its block's bytes", "[construct][copy][trivial]")
+{
+    REQUIRE(detail::is_trivial_block<detail::direct_control_block<message>>::value);
+    REQUIRE(!detail::is_trivial_block<detail::direct_control_block<derived>>::value);
+
+    GIVEN("an `indirect<message>` on the free store")
+    {
+        indirect<message> m{message{1, {1.0, 2.0, 3.0}}};
+
+        WHEN("it is copied")
+        {
+            auto copy = m;
+            copy->payload[0] = 4.0;
+
+            THEN("the copy is an independent object")
+            {
+                REQUIRE(copy->id == 1);
+                REQUIRE(copy->payload[0] == 4.0);
+                REQUIRE(copy->payload[2] == 3.0);
+                REQUIRE(m->payload[0] == 1.0);
+                REQUIRE(&*copy != &*m);
+            }
+        }
+
+        WHEN("it is copy assigned over an `indirect` of the same type")
+        {
+            indirect<message> other{message{2, {}}};
+            other = m;
+
+            THEN("the object is copied")
+            {
+                REQUIRE(other->id == 1);
+                REQUIRE(other->payload[1] == 2.0);
+            }
+        }
+
+        WHEN("a `message` is emplaced")
+        {
+            auto p = &*m;
+            m.emplace<message>(message{5, {}});
+
+            THEN("it reuses the memory of the old one")
+            {
+                REQUIRE(&*m == p);
+                REQUIRE(m->id == 5);
+            }
+        }
+    }
+
+    GIVEN("an inline `indirect<message>`")
+    {
+        indirect<message, inline_storage<64>> m{message{1, {1.0, 2.0, 3.0}}};
+        REQUIRE(is_stored_inline(m));
+
+        WHEN("it is copied and moved")
+        {
+            auto copy = m;
+            auto moved = std::move(copy);
+
+            THEN("the objects stay inline and point into their own `indirect`")
+            {
+                REQUIRE(is_stored_inline(moved));
+                REQUIRE(moved->id == 1);
+                REQUIRE(moved->payload[2] == 3.0);
+                REQUIRE(!copy);
+                REQUIRE(m->payload[1] == 2.0);
+            }
+        }
+    }
+
+    GIVEN("a vector of `indirect<message>`")
+    {
+        std::vector<indirect<message>> v;
+        for (int i = 0; i < 8; ++i)
+        {
+            v.emplace_back(message{i, {}});
+        }
+
+        THEN("a copy of the vector copies every object")
+        {
+            auto copy = v;
+            for (int i = 0; i < 8; ++i)
+            {
+                REQUIRE(copy[i]->id == i);
+                REQUIRE(&*copy[i] != &*v[i]);
+            }
+        }
+    }
+}
+
+SCENARIO("`indirect`s compare and hash as their objects do", "[compare][hash]")
+{
+    GIVEN("`indirect<std::string>`s and an empty one")
+    {
+        indirect<std::string> a{std::string("a")};
+        indirect<std::string> b{std::string("b")};
+        indirect<std::string, inline_storage<64>> other_a{std::string("a")};
+        indirect<std::string> empty{std::string()};
+        auto taken = std::move(empty);
+
+        THEN("they compare by their objects, whatever the storage")
+        {
+            REQUIRE(a == other_a);
+            REQUIRE(a != b);
+            REQUIRE(a < b);
+            REQUIRE(a <= other_a);
+            REQUIRE(b > a);
+            REQUIRE(b >= a);
+        }
+
+        THEN("an empty `indirect` equals only an empty one and orders first")
+        {
+            REQUIRE(empty == empty);
+            REQUIRE(empty != a);
+            REQUIRE(empty < a);
+            REQUIRE(!(a < empty));
+            REQUIRE(empty <= empty);
+            REQUIRE(a > empty);
+            REQUIRE(a >= empty);
+            REQUIRE(!(empty > empty));
+        }
+
+        THEN("`std::hash` hashes the object")
+        {
+            REQUIRE(std::hash<indirect<std::string>>()(a) == std::hash<std::string>()("a"));
+            REQUIRE(std::hash<indirect<std::string>>()(empty) == 0);
+        }
+
+        THEN("they can be the keys of hash containers")
+        {
+            std::unordered_set<indirect<std::string>> set{a, b};
+            REQUIRE(set.count(indirect<std::string>{std::string("a")}) == 1);
+            REQUIRE(set.count(indirect<std::string>{std::string("c")}) == 0);
+        }
     }
 }
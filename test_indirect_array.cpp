@@ -0,0 +1,98 @@
+#include <catch.hpp>
+#include <indirect_array.h>
+
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+
+    class particle
+    {
+    private:
+        int value;
+
+    public:
+        static size_t object_count;
+        static size_t throw_after;
+
+    public:
+        particle(int v) : value(v)
+        {
+            if (throw_after && object_count + 1 == throw_after)
+            {
+                throw std::runtime_error("particle");
+            }
+            ++object_count;
+        }
+        particle(particle const& other) : value(other.value) { ++object_count; }
+        ~particle() { --object_count; }
+        int get_value() const { return value; }
+        void set_value(int i) { value = i; }
+    };
+
+    size_t particle::object_count = 0u;
+    size_t particle::throw_after = 0u;
+
+} // namespace
+
+SCENARIO("`make_indirect_array` creates elements in one allocation", "[array][construct]")
+{
+    GIVEN("an array of 100 `indirect<particle>`")
+    {
+        auto v = make_indirect_array<particle>(100, 42);
+
+        THEN("the objects are contiguous and equally spaced")
+        {
+            REQUIRE(v.size() == 100);
+            REQUIRE(particle::object_count == 100);
+            auto stride = reinterpret_cast<char const*>(&*v[1]) - reinterpret_cast<char const*>(&*v[0]);
+            REQUIRE(reinterpret_cast<char const*>(&*v[99]) - reinterpret_cast<char const*>(&*v[0]) == 99 * stride);
+            REQUIRE(v[99]->get_value() == 42);
+        }
+
+        WHEN("an element is copied and modified")
+        {
+            auto copy = v[3];
+            copy->set_value(7);
+
+            THEN("only that element is cloned")
+            {
+                REQUIRE(particle::object_count == 101);
+                REQUIRE(v[3]->get_value() == 42);
+                REQUIRE(copy->get_value() == 7);
+            }
+        }
+
+        WHEN("elements are moved out and the array is destroyed")
+        {
+            auto kept = std::move(v[5]);
+            std::vector<indirect<particle>> others(v.begin() + 10, v.begin() + 20);
+            v.clear();
+
+            THEN("the moved elements are still valid")
+            {
+                REQUIRE(particle::object_count == 11);
+                REQUIRE(kept->get_value() == 42);
+                REQUIRE(others[9]->get_value() == 42);
+            }
+        }
+    }
+
+    GIVEN("an empty array")
+    {
+        REQUIRE(make_indirect_array<particle>(0, 42).empty());
+    }
+
+    REQUIRE(particle::object_count == 0);
+}
+
+SCENARIO("`make_indirect_array` cleans up when a construction throws", "[array][exception]")
+{
+    particle::throw_after = 10;
+
+    REQUIRE_THROWS_AS(make_indirect_array<particle>(20, 1), std::runtime_error);
+    REQUIRE(particle::object_count == 0);
+
+    particle::throw_after = 0;
+}
@@ -0,0 +1,144 @@
+#include <catch.hpp>
+#include <indirect_parallel.h>
+#include <pooled_indirect.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+
+    class base
+    {
+    public:
+        static std::atomic<size_t> object_count;
+
+        base() { ++object_count; }
+        base(base const&) { ++object_count; }
+        virtual ~base() { --object_count; }
+        virtual int value() const = 0;
+    };
+
+    std::atomic<size_t> base::object_count{0u};
+
+    class derived : public base
+    {
+    private:
+        int v;
+
+    public:
+        static std::atomic<size_t> throw_after;
+
+        derived(int i) : v(i) {}
+        derived(derived const& other) : base(other), v(other.v)
+        {
+            if (throw_after && --throw_after == 0)
+            {
+                throw std::runtime_error("derived");
+            }
+        }
+        int value() const override { return v; }
+    };
+
+    std::atomic<size_t> derived::throw_after{0u};
+
+    constexpr size_t many = 3 * detail::parallel_copy_grain + 5;
+
+    template <typename I>
+    std::vector<I> make_many()
+    {
+        std::vector<I> v;
+        for (size_t i = 0; i < many; ++i)
+        {
+            v.push_back(I{derived{static_cast<int>(i)}});
+        }
+        return v;
+    }
+
+} // namespace
+
+SCENARIO("`parallel_copy` copies every element", "[parallel][copy]")
+{
+    GIVEN("a large vector of `indirect<base>`")
+    {
+        auto v = make_many<indirect<base>>();
+
+        WHEN("it is copied on four threads")
+        {
+            auto copy = parallel_copy(v, 4);
+
+            THEN("each element is cloned in place")
+            {
+                REQUIRE(base::object_count == 2 * many);
+                REQUIRE(copy.size() == many);
+                size_t mismatches = 0;
+                for (size_t i = 0; i < many; ++i)
+                {
+                    mismatches += copy[i]->value() != static_cast<int>(i) || &*copy[i] == &*v[i];
+                }
+                REQUIRE(mismatches == 0);
+            }
+        }
+
+        WHEN("it is copied with the default number of threads")
+        {
+            auto copy = parallel_copy(v);
+
+            THEN("the copy is complete")
+            {
+                REQUIRE(copy.size() == many);
+                REQUIRE(copy.back()->value() == static_cast<int>(many - 1));
+            }
+        }
+    }
+
+    GIVEN("a large vector of `pooled_indirect<base>`")
+    {
+        auto v = make_many<pooled_indirect<base>>();
+
+        WHEN("it is copied on four threads and both are destroyed here")
+        {
+            {
+                auto copy = parallel_copy(v, 4);
+                REQUIRE(copy[many / 2]->value() == static_cast<int>(many / 2));
+            }
+            v.clear();
+
+            THEN("every object is destroyed")
+            {
+                REQUIRE(base::object_count == 0);
+            }
+        }
+    }
+
+    GIVEN("a small vector")
+    {
+        auto v = std::vector<indirect<base>>{indirect<base>{derived{1}}, indirect<base>{derived{2}}};
+
+        THEN("it is copied as usual")
+        {
+            auto copy = parallel_copy(v, 8);
+            REQUIRE(copy.size() == 2);
+            REQUIRE(copy[1]->value() == 2);
+        }
+    }
+
+    REQUIRE(base::object_count == 0);
+}
+
+SCENARIO("`parallel_copy` rethrows the exception of a failed clone", "[parallel][exception]")
+{
+    GIVEN("a large vector whose copy throws")
+    {
+        auto v = make_many<indirect<base>>();
+        derived::throw_after = many / 2;
+
+        REQUIRE_THROWS_AS(parallel_copy(v, 4), std::runtime_error);
+        REQUIRE(base::object_count == many);
+
+        derived::throw_after = 0;
+    }
+
+    REQUIRE(base::object_count == 0);
+}
@@ -0,0 +1,104 @@
+#include <catch.hpp>
+#include <indirect.h>
+#include <indirect_prefetch.h>
+
+#include <list>
+#include <vector>
+
+namespace
+{
+
+    class base
+    {
+    public:
+        virtual ~base() = default;
+        virtual int value() const = 0;
+    };
+
+    class derived : public base
+    {
+    private:
+        int v;
+
+    public:
+        derived(int i) : v(i) {}
+        int value() const override { return v; }
+    };
+
+    template <typename Range>
+    std::vector<int> values(Range const& r)
+    {
+        std::vector<int> v;
+        for (auto const& i : r)
+        {
+            v.push_back(i ? i->value() : -1);
+        }
+        return v;
+    }
+
+} // namespace
+
+SCENARIO("`for_each_indirect` visits every element in order", "[prefetch]")
+{
+    GIVEN("a vector of `indirect<base>` with an empty element")
+    {
+        std::vector<indirect<base>> v;
+        for (int i = 0; i < 40; ++i)
+        {
+            v.emplace_back(derived{i});
+        }
+        auto taken = std::move(v[7]);
+        auto expected = values(v);
+
+        THEN("each distance visits the same elements")
+        {
+            for (std::size_t distance : {0, 1, 16, 39, 40, 100})
+            {
+                std::vector<int> seen;
+                for_each_indirect(v, [&](indirect<base> const& i) { seen.push_back(i ? i->value() : -1); }, distance);
+                REQUIRE(seen == expected);
+            }
+        }
+
+        THEN("a prefetched range iterates as the vector does")
+        {
+            REQUIRE(values(prefetched(v)) == expected);
+            REQUIRE(values(prefetched(v, 100)) == expected);
+        }
+
+        THEN("elements can be modified through the range")
+        {
+            for (auto& i : prefetched(v))
+            {
+                i = derived{1};
+            }
+            REQUIRE(values(v) == std::vector<int>(40, 1));
+        }
+    }
+
+    GIVEN("a list of `indirect<base>`")
+    {
+        std::list<indirect<base>> l;
+        for (int i = 0; i < 10; ++i)
+        {
+            l.emplace_back(derived{i});
+        }
+
+        THEN("it is visited through its iterators")
+        {
+            int sum = 0;
+            for_each_indirect(l, [&](indirect<base> const& i) { sum += i->value(); }, 3);
+            REQUIRE(sum == 45);
+        }
+    }
+
+    GIVEN("an empty vector")
+    {
+        std::vector<indirect<base>> v;
+        int calls = 0;
+        for_each_indirect(v, [&](indirect<base> const&) { ++calls; });
+
+        REQUIRE(calls == 0);
+        REQUIRE(prefetched(v).begin() == prefetched(v).end());
+    }
+}
@@ -0,0 +1,289 @@
+#include <catch.hpp>
+#include <indirect_serialization.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+    class component
+    {
+    public:
+        static size_t object_count;
+
+        component() { ++object_count; }
+        component(component const&) { ++object_count; }
+        virtual ~component() { --object_count; }
+        virtual std::string describe() const = 0;
+    };
+
+    size_t component::object_count = 0u;
+
+    class position : public component
+    {
+    public:
+        int x;
+        int y;
+
+        position(int x_, int y_) : x(x_), y(y_) {}
+        std::string describe() const override { return std::to_string(x) + "," + std::to_string(y); }
+    };
+
+    class label : public component
+    {
+    public:
+        std::string text;
+
+        explicit label(std::string t) : text(std::move(t)) {}
+        std::string describe() const override { return text; }
+    };
+
+    class unregistered : public component
+    {
+    public:
+        std::string describe() const override { return "?"; }
+    };
+
+} // namespace
+
+template <>
+struct indirect_serializer<position>
+{
+    static void save(indirect_writer& w, position const& p)
+    {
+        w.write(std::int32_t{p.x});
+        w.write(std::int32_t{p.y});
+    }
+
+    static position load(indirect_reader& r)
+    {
+        auto x = r.read<std::int32_t>();
+        auto y = r.read<std::int32_t>();
+        return position(x, y);
+    }
+};
+
+template <>
+struct indirect_serializer<label>
+{
+    static void save(indirect_writer& w, label const& l)
+    {
+        w.write(static_cast<std::uint32_t>(l.text.size()));
+        w.write_bytes(l.text.data(), l.text.size());
+    }
+
+    static label load(indirect_reader& r)
+    {
+        auto n = r.read<std::uint32_t>();
+        return label(std::string(r.read_bytes(n), n));
+    }
+};
+
+namespace
+{
+
+    indirect_registry<component> make_registry()
+    {
+        indirect_registry<component> registry;
+        registry.add<position>(1);
+        registry.add<label>(2);
+        return registry;
+    }
+
+} // namespace
+
+SCENARIO("`indirect_registry` writes and reads single objects", "[serialization]")
+{
+    auto registry = make_registry();
+    std::vector<char> bytes;
+    indirect_writer w(bytes);
+
+    GIVEN("`indirect<component>`s of registered types and an empty one")
+    {
+        indirect<component> p{position{1, 2}};
+        indirect<component> l{label{"hello"}};
+        indirect<component> empty{position{0, 0}};
+        auto taken = std::move(empty);
+
+        registry.save(w, p);
+        registry.save(w, l);
+        registry.save(w, empty);
+
+        THEN("each is written as its id and its members")
+        {
+            REQUIRE(bytes.size() == (4 + 8) + (4 + 4 + 5) + 4);
+        }
+
+        WHEN("they are read back")
+        {
+            indirect_reader r(bytes.data(), bytes.size());
+            auto p2 = registry.load(r);
+            auto l2 = registry.load(r);
+            auto e2 = registry.load(r);
+
+            THEN("the objects are restored with their dynamic types")
+            {
+                REQUIRE(p2.holds_type<position>());
+                REQUIRE(p2->describe() == "1,2");
+                REQUIRE(l2.holds_type<label>());
+                REQUIRE(l2->describe() == "hello");
+                REQUIRE(!e2);
+                REQUIRE(r.remaining() == 0);
+            }
+        }
+    }
+
+    GIVEN("an `indirect` of a type that is not registered")
+    {
+        indirect<component> u{unregistered{}};
+
+        REQUIRE_THROWS_AS(registry.save(w, u), indirect_serialization_error);
+    }
+
+    GIVEN("a buffer with an unknown id or cut short")
+    {
+        indirect<component> p{position{1, 2}};
+        registry.save(w, p);
+
+        indirect_reader short_reader(bytes.data(), bytes.size() - 1);
+        REQUIRE_THROWS_AS(registry.load(short_reader), indirect_serialization_error);
+
+        bytes[0] = 9;
+        indirect_reader unknown_reader(bytes.data(), bytes.size());
+        REQUIRE_THROWS_AS(registry.load(unknown_reader), indirect_serialization_error);
+    }
+
+    THEN("ids and types are registered once")
+    {
+        indirect_registry<component> partial;
+        partial.add<position>(1);
+
+        REQUIRE_THROWS_AS(partial.add<label>(1), indirect_serialization_error);
+        REQUIRE_THROWS_AS(partial.add<label>(0), indirect_serialization_error);
+        REQUIRE_THROWS_AS(partial.add<position>(2), indirect_serialization_error);
+        partial.add<label>(2);
+    }
+
+    REQUIRE(component::object_count == 0);
+}
+
+SCENARIO("`indirect_registry` writes vectors in runs of one type", "[serialization][vector]")
+{
+    auto registry = make_registry();
+    std::vector<char> bytes;
+    indirect_writer w(bytes);
+
+    GIVEN("a vector with runs of positions, labels and empty elements")
+    {
+        std::vector<indirect<component>> v;
+        for (int i = 0; i < 5; ++i)
+        {
+            v.emplace_back(position{i, -i});
+        }
+        v.emplace_back(label{"a"});
+        v.emplace_back(label{"b"});
+        v.push_back(detail::indirect_access::empty<component, heap_storage>());
+        v.emplace_back(position{9, 9});
+
+        registry.save(w, v);
+
+        THEN("each run has one header")
+        {
+            REQUIRE(bytes.size() == 8 + (12 + 5 * 8) + (12 + 2 * 5) + 12 + (12 + 8));
+        }
+
+        WHEN("it is read back")
+        {
+            indirect_reader r(bytes.data(), bytes.size());
+            auto v2 = registry.load_vector(r);
+
+            THEN("the elements are restored in order")
+            {
+                REQUIRE(v2.size() == v.size());
+                std::vector<std::string> described;
+                for (auto const& c : v2)
+                {
+                    described.push_back(c ? c->describe() : "");
+                }
+                REQUIRE(described ==
+                        (std::vector<std::string>{"0,0", "1,-1", "2,-2", "3,-3", "4,-4", "a", "b", "", "9,9"}));
+                REQUIRE(r.remaining() == 0);
+            }
+
+            THEN("the objects of a run are allocated together")
+            {
+                auto stride = reinterpret_cast<char const*>(&*v2[1]) - reinterpret_cast<char const*>(&*v2[0]);
+                REQUIRE(reinterpret_cast<char const*>(&*v2[4]) - reinterpret_cast<char const*>(&*v2[0]) ==
+                        4 * stride);
+                REQUIRE(stride > 0);
+            }
+
+            THEN("the elements are independent values")
+            {
+                auto copy = v2[2];
+                v2.clear();
+                REQUIRE(copy->describe() == "2,-2");
+                REQUIRE(component::object_count == 8 + 1);
+            }
+        }
+    }
+
+    GIVEN("a buffer whose size does not match its runs")
+    {
+        std::vector<indirect<component>> v;
+        v.emplace_back(position{1, 1});
+        registry.save(w, v);
+
+        bytes[0] = 2;
+        indirect_reader too_small(bytes.data(), bytes.size());
+        REQUIRE_THROWS_AS(registry.load_vector(too_small), indirect_serialization_error);
+
+        bytes[0] = 1;
+        bytes[12] = 5;
+        indirect_reader too_long(bytes.data(), bytes.size());
+        REQUIRE_THROWS_AS(registry.load_vector(too_long), indirect_serialization_error);
+    }
+
+    GIVEN("buffers that claim more elements than they hold")
+    {
+        auto huge = std::uint64_t{1} << 62;
+
+        THEN("a run of empty elements longer than the buffer is rejected")
+        {
+            w.write(huge);
+            w.write(std::uint32_t{0});
+            w.write(huge);
+            indirect_reader r(bytes.data(), bytes.size());
+            REQUIRE_THROWS_AS(registry.load_vector(r), indirect_serialization_error);
+        }
+
+        THEN("a run of objects longer than the buffer is rejected before it is allocated")
+        {
+            w.write(huge);
+            w.write(std::uint32_t{1});
+            w.write(huge);
+            indirect_reader r(bytes.data(), bytes.size());
+            REQUIRE_THROWS_AS(registry.load_vector(r, huge), indirect_serialization_error);
+        }
+    }
+
+    GIVEN("a vector of more empty elements than bytes")
+    {
+        std::vector<indirect<component>> v(100, detail::indirect_access::empty<component, heap_storage>());
+        registry.save(w, v);
+
+        THEN("it is read only up to the size allowed")
+        {
+            indirect_reader r(bytes.data(), bytes.size());
+            REQUIRE_THROWS_AS(registry.load_vector(r), indirect_serialization_error);
+            indirect_reader r2(bytes.data(), bytes.size());
+            REQUIRE_THROWS_AS(registry.load_vector(r2, 99), indirect_serialization_error);
+            indirect_reader r3(bytes.data(), bytes.size());
+            REQUIRE(registry.load_vector(r3, 100).size() == 100);
+        }
+    }
+
+    REQUIRE(component::object_count == 0);
+}
@@ -0,0 +1,219 @@
+#include <catch.hpp>
+#include <indirect_vector.h>
+
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+    class shape
+    {
+    public:
+        int id;
+        static size_t object_count;
+
+        shape(int i) : id(i) { ++object_count; }
+        shape(shape const& other) : id(other.id) { ++object_count; }
+        virtual ~shape() { --object_count; }
+        virtual int sides() const = 0;
+    };
+
+    size_t shape::object_count = 0u;
+
+    class triangle final : public shape
+    {
+    public:
+        triangle(int i) : shape(i) {}
+        int sides() const override { return 3; }
+    };
+
+    class square : public shape
+    {
+    public:
+        static size_t throw_after;
+
+        square(int i) : shape(i) {}
+        square(square const& other) : shape(other)
+        {
+            if (throw_after && shape::object_count >= throw_after)
+            {
+                throw std::runtime_error("square");
+            }
+        }
+        int sides() const override { return 4; }
+    };
+
+    size_t square::throw_after = 0u;
+
+} // namespace
+
+SCENARIO("`indirect_vector` groups elements by dynamic type", "[vector][construct]")
+{
+    GIVEN("an `indirect_vector<shape>` with interleaved types")
+    {
+        indirect_vector<shape> v;
+        for (int i = 0; i < 20; ++i)
+        {
+            if (i % 2)
+            {
+                v.emplace<square>(i);
+            }
+            else
+            {
+                v.push_back(triangle{i});
+            }
+        }
+
+        THEN("the elements are counted per type")
+        {
+            REQUIRE(v.size() == 20);
+            REQUIRE(v.size<triangle>() == 10);
+            REQUIRE(v.size<square>() == 10);
+            REQUIRE(shape::object_count == 20);
+        }
+
+        THEN("`for_each` visits each type's segment in insertion order")
+        {
+            std::vector<int> sides;
+            v.for_each([&](shape const& s) { sides.push_back(s.sides()); });
+            std::vector<int> expected(10, 3);
+            expected.resize(20, 4);
+            REQUIRE(sides == expected);
+        }
+
+        THEN("named types are visited with their static type")
+        {
+            std::vector<int> ids;
+            int others = 0;
+            struct visitor
+            {
+                std::vector<int>& ids;
+                int& others;
+                void operator()(triangle& t) { ids.push_back(t.id); }
+                void operator()(shape&) { ++others; }
+            };
+            v.for_each<triangle>(visitor{ids, others});
+            REQUIRE(ids == (std::vector<int>{0, 2, 4, 6, 8, 10, 12, 14, 16, 18}));
+            REQUIRE(others == 10);
+        }
+
+        WHEN("the vector is copied")
+        {
+            auto copy = v;
+            copy.for_each<square, triangle>([](auto& s) { s.id = -1; });
+
+            THEN("every element is copied")
+            {
+                REQUIRE(shape::object_count == 40);
+                REQUIRE(copy.size<square>() == 10);
+                int sum = 0;
+                v.for_each<square, triangle>([&](auto const& s) { sum += s.id; });
+                REQUIRE(sum == 190);
+            }
+        }
+
+        WHEN("another vector is assigned a copy of it")
+        {
+            indirect_vector<shape> other;
+            other.emplace<square>(100);
+            other.emplace<triangle>(101);
+            other = v;
+
+            THEN("the other vector's elements are replaced by copies")
+            {
+                REQUIRE(shape::object_count == 40);
+                REQUIRE(other.size() == 20);
+                REQUIRE(other.size<triangle>() == 10);
+                int sum = 0;
+                other.for_each([&](shape const& s) { sum += s.id; });
+                REQUIRE(sum == 190);
+            }
+        }
+
+        WHEN("another vector is move assigned from it")
+        {
+            indirect_vector<shape> other;
+            other.emplace<square>(100);
+            other = std::move(v);
+
+            THEN("the other vector takes its elements")
+            {
+                REQUIRE(shape::object_count == 20);
+                REQUIRE(other.size() == 20);
+                REQUIRE(other.size<square>() == 10);
+            }
+        }
+
+        WHEN("the vector is moved from and cleared")
+        {
+            auto moved = std::move(v);
+            REQUIRE(shape::object_count == 20);
+            moved.clear();
+
+            THEN("the elements are destroyed")
+            {
+                REQUIRE(moved.empty());
+                REQUIRE(shape::object_count == 0);
+            }
+        }
+    }
+
+    REQUIRE(shape::object_count == 0);
+}
+
+SCENARIO("`indirect_vector` copies are exception safe", "[vector][exception]")
+{
+    GIVEN("an `indirect_vector<shape>` whose copy throws part way")
+    {
+        indirect_vector<shape> v;
+        for (int i = 0; i < 10; ++i)
+        {
+            v.emplace<triangle>(i);
+            v.emplace<square>(i);
+        }
+        square::throw_after = 25;
+
+        REQUIRE_THROWS_AS(indirect_vector<shape>(v), std::runtime_error);
+        REQUIRE(shape::object_count == 20);
+
+        square::throw_after = 0;
+    }
+
+    REQUIRE(shape::object_count == 0);
+}
+
+SCENARIO("`indirect_vector` appends its own elements", "[vector][construct]")
+{
+    GIVEN("an `indirect_vector<shape>` whose segment is full")
+    {
+        indirect_vector<shape> v;
+        for (int i = 0; i < 8; ++i)
+        {
+            v.emplace<triangle>(i);
+        }
+        shape const* first = nullptr;
+        v.for_each([&](shape const& s) {
+            if (!first)
+            {
+                first = &s;
+            }
+        });
+
+        WHEN("one of its elements is appended")
+        {
+            v.push_back(static_cast<triangle const&>(*first));
+
+            THEN("the copy is made before the segment grows")
+            {
+                std::vector<int> ids;
+                v.for_each([&](shape const& s) { ids.push_back(s.id); });
+                REQUIRE(ids == (std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 0}));
+                REQUIRE(shape::object_count == 9);
+            }
+        }
+    }
+
+    REQUIRE(shape::object_count == 0);
+}
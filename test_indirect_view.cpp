@@ -0,0 +1,216 @@
+#include <catch.hpp>
+#include <indirect_view.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+    class component
+    {
+    public:
+        static size_t object_count;
+
+        component() { ++object_count; }
+        component(component const&) { ++object_count; }
+        virtual ~component() { --object_count; }
+        virtual std::string describe() const = 0;
+    };
+
+    size_t component::object_count = 0u;
+
+    class position : public component
+    {
+    public:
+        int x;
+        int y;
+
+        position(int x_, int y_) : x(x_), y(y_) {}
+        std::string describe() const override { return std::to_string(x) + "," + std::to_string(y); }
+    };
+
+    class label : public component
+    {
+    public:
+        std::string text;
+
+        explicit label(std::string t) : text(std::move(t)) {}
+        std::string describe() const override { return text; }
+    };
+
+} // namespace
+
+template <>
+struct indirect_serializer<position>
+{
+    static void save(indirect_writer& w, position const& p)
+    {
+        w.write(std::int32_t{p.x});
+        w.write(std::int32_t{p.y});
+    }
+
+    static position load(indirect_reader& r)
+    {
+        auto x = r.read<std::int32_t>();
+        auto y = r.read<std::int32_t>();
+        return position(x, y);
+    }
+};
+
+template <>
+struct indirect_serializer<label>
+{
+    static void save(indirect_writer& w, label const& l)
+    {
+        w.write(static_cast<std::uint32_t>(l.text.size()));
+        w.write_bytes(l.text.data(), l.text.size());
+    }
+
+    static label load(indirect_reader& r)
+    {
+        auto n = r.read<std::uint32_t>();
+        return label(std::string(r.read_bytes(n), n));
+    }
+};
+
+namespace
+{
+
+    indirect_registry<component> make_registry()
+    {
+        indirect_registry<component> registry;
+        registry.add<position>(1);
+        registry.add<label>(2);
+        return registry;
+    }
+
+    std::vector<char> make_arena(indirect_registry<component> const& registry)
+    {
+        std::vector<indirect<component>> v;
+        v.emplace_back(position{1, 2});
+        v.emplace_back(label{"hello"});
+        indirect<component> empty{position{0, 0}};
+        auto taken = std::move(empty);
+        v.push_back(std::move(empty));
+        v.emplace_back(position{3, 4});
+
+        std::vector<char> bytes;
+        indirect_writer w(bytes);
+        registry.save_arena(w, v);
+        return bytes;
+    }
+
+} // namespace
+
+SCENARIO("`indirect_arena_view` views objects in place", "[view]")
+{
+    auto registry = make_registry();
+    auto bytes = make_arena(registry);
+
+    GIVEN("an arena view over a buffer")
+    {
+        indirect_arena_view<component> arena(registry, bytes.data(), bytes.size());
+
+        THEN("its elements are viewed without constructing objects")
+        {
+            REQUIRE(component::object_count == 0);
+            REQUIRE(arena.size() == 4);
+            REQUIRE(arena[0].holds_type<position>());
+            REQUIRE(arena[1].holds_type<label>());
+            REQUIRE(!arena[2]);
+            REQUIRE(arena[3].holds_type<position>());
+            REQUIRE(component::object_count == 0);
+        }
+
+        THEN("the fields of an element are read in place")
+        {
+            auto r = arena[1].reader();
+            auto n = r.read<std::uint32_t>();
+            auto text = r.read_bytes(n);
+
+            REQUIRE(std::string(text, n) == "hello");
+            REQUIRE(text > bytes.data());
+            REQUIRE(text < bytes.data() + bytes.size());
+        }
+
+        WHEN("an element is loaded")
+        {
+            auto p = arena[3].load();
+            static_cast<position&>(*p).x = 7;
+
+            THEN("it is a modifiable copy")
+            {
+                REQUIRE(component::object_count == 1);
+                REQUIRE(p->describe() == "7,4");
+                REQUIRE(arena[3].load()->describe() == "3,4");
+            }
+        }
+
+        WHEN("every element is loaded")
+        {
+            auto v = arena.load();
+
+            REQUIRE(v.size() == 4);
+            REQUIRE(v[1]->describe() == "hello");
+            REQUIRE(!v[2]);
+        }
+    }
+
+    GIVEN("a buffer too short for its offsets")
+    {
+        REQUIRE_THROWS_AS(indirect_arena_view<component>(registry, bytes.data(), 16), indirect_serialization_error);
+    }
+
+    GIVEN("an arena whose element offset lies outside the buffer")
+    {
+        bytes[8] = 127;
+        indirect_arena_view<component> arena(registry, bytes.data(), bytes.size());
+
+        REQUIRE_THROWS_AS(arena[0], indirect_serialization_error);
+    }
+
+    REQUIRE(component::object_count == 0);
+}
+
+#ifdef INDIRECT_HAS_MMAP
+SCENARIO("`indirect_mapped_file` maps an arena", "[view][mmap]")
+{
+    auto registry = make_registry();
+
+    GIVEN("an arena written to a file")
+    {
+        auto bytes = make_arena(registry);
+        char path[] = "/tmp/indirect_view_XXXXXX";
+        int fd = ::mkstemp(path);
+        REQUIRE(fd >= 0);
+        REQUIRE(::write(fd, bytes.data(), bytes.size()) == static_cast<ssize_t>(bytes.size()));
+        ::close(fd);
+
+        WHEN("the file is mapped")
+        {
+            indirect_mapped_file file(path);
+            indirect_arena_view<component> arena(registry, file.data(), file.size());
+
+            THEN("its elements are viewed from the mapping")
+            {
+                REQUIRE(file.size() == bytes.size());
+                REQUIRE(arena.size() == 4);
+                REQUIRE(arena[0].load()->describe() == "1,2");
+            }
+        }
+
+        ::unlink(path);
+    }
+
+    GIVEN("a file that does not exist")
+    {
+        REQUIRE_THROWS_AS(indirect_mapped_file("/nonexistent/indirect_view"), std::system_error);
+    }
+
+    REQUIRE(component::object_count == 0);
+}
+#endif
@@ -0,0 +1,383 @@
+#include <catch.hpp>
+#include <compact_indirect.h>
+#include <indirect.h>
+
+#include <cstring>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <vector>
+
+namespace
+{
+
+    class base
+    {
+    public:
+        virtual ~base() = default;
+        virtual int get_value() const = 0;
+    };
+
+    class derived : public base
+    {
+    private:
+        int value;
+
+    public:
+        derived(int v) : value(v) {}
+        int get_value() const override { return value; }
+    };
+
+    class derived_other : public base
+    {
+    private:
+        int value;
+
+    public:
+        derived_other(int v) : value(v) {}
+        int get_value() const override { return -value; }
+    };
+
+    indirect_block_stats stats_for(std::type_info const& type, char const* block)
+    {
+        for (auto const& s : indirect_instrumentation_snapshot())
+        {
+            if (*s.type == type && std::strcmp(s.block, block) == 0)
+            {
+                return s;
+            }
+        }
+        return {&type, block, 0, 0, 0, 0, 0, 0, 0, 0};
+    }
+
+    indirect_site_stats stats_for(indirect_call_site const& site)
+    {
+        for (auto const& s : indirect_instrumentation_sites())
+        {
+            if (s.file == site.file && s.line == site.line)
+            {
+                return s;
+            }
+        }
+        return {site.file, site.line, site.function, 0, 0, 0, 0, 0};
+    }
+
+} // namespace
+
+SCENARIO("instrumentation counts heap control blocks", "[instrumentation]")
+{
+    indirect_instrumentation_reset();
+
+    GIVEN("an `indirect<base>` holding a `derived` and a copy of it")
+    {
+        {
+            indirect<base> b(derived(7));
+            auto c = b;
+            auto d = std::move(c);
+            REQUIRE(d->get_value() == 7);
+        }
+
+        THEN("constructions, copies, destroys and allocations are counted")
+        {
+            auto s = stats_for(typeid(derived), "direct");
+            REQUIRE(s.constructions == 1);
+            REQUIRE(s.copies == 1);
+            REQUIRE(s.moves == 0);
+            REQUIRE(s.destroys == 2);
+            REQUIRE(s.allocations == 2);
+            REQUIRE(s.deallocations == 2);
+            REQUIRE(s.allocated_bytes == s.deallocated_bytes);
+            REQUIRE(s.allocated_bytes >= 2 * sizeof(derived));
+        }
+    }
+}
+
+SCENARIO("instrumentation counts copy assignments that reuse a block", "[instrumentation]")
+{
+    indirect_instrumentation_reset();
+
+    GIVEN("an `indirect<base>` assigned from another holding the same type")
+    {
+        {
+            indirect<base> b(derived(7));
+            indirect<base> c(derived(8));
+            c = b;
+            REQUIRE(c->get_value() == 7);
+        }
+
+        THEN("the assignment copies without allocating")
+        {
+            auto s = stats_for(typeid(derived), "direct");
+            REQUIRE(s.constructions == 2);
+            REQUIRE(s.copies == 1);
+            REQUIRE(s.allocations == 2);
+            REQUIRE(s.deallocations == 2);
+            REQUIRE(s.live == 0);
+        }
+    }
+}
+
+SCENARIO("instrumentation counts emplaced objects", "[instrumentation]")
+{
+    indirect_instrumentation_reset();
+
+    GIVEN("an `indirect<base>` whose object is replaced by one of the same type")
+    {
+        {
+            indirect<base> b(derived(7));
+            b.emplace<derived>(8);
+            REQUIRE(b->get_value() == 8);
+        }
+
+        THEN("the new object is constructed without allocating")
+        {
+            auto s = stats_for(typeid(derived), "direct");
+            REQUIRE(s.constructions == 2);
+            REQUIRE(s.destroys == 2);
+            REQUIRE(s.allocations == 1);
+            REQUIRE(s.deallocations == 1);
+        }
+    }
+}
+
+SCENARIO("instrumentation counts blocks reused for another type", "[instrumentation]")
+{
+    indirect_instrumentation_reset();
+
+    GIVEN("an `indirect<base>` whose object is replaced by one of another type")
+    {
+        {
+            indirect<base> b(derived(7));
+            b.emplace<derived_other>(8);
+            REQUIRE(b->get_value() == -8);
+        }
+
+        THEN("each type allocates and frees its block once")
+        {
+            auto d = stats_for(typeid(derived), "direct");
+            auto o = stats_for(typeid(derived_other), "direct");
+            REQUIRE(d.allocations == 1);
+            REQUIRE(d.deallocations == 1);
+            REQUIRE(d.allocated_bytes == d.deallocated_bytes);
+            REQUIRE(o.allocations == 1);
+            REQUIRE(o.deallocations == 1);
+            REQUIRE(o.allocated_bytes == o.deallocated_bytes);
+            REQUIRE(d.live == 0);
+            REQUIRE(o.live == 0);
+        }
+    }
+}
+
+SCENARIO("instrumentation counts inline control blocks", "[instrumentation]")
+{
+    indirect_instrumentation_reset();
+
+    GIVEN("an inline `indirect<base>` that is moved")
+    {
+        {
+            indirect<base, inline_storage<4 * sizeof(void*)>> b(derived(7));
+            auto c = std::move(b);
+            REQUIRE(c->get_value() == 7);
+        }
+
+        THEN("moves are counted and nothing is allocated")
+        {
+            auto s = stats_for(typeid(derived), "direct");
+            REQUIRE(s.constructions == 1);
+            REQUIRE(s.moves == 1);
+            REQUIRE(s.destroys == 2);
+            REQUIRE(s.allocations == 0);
+        }
+    }
+}
+
+SCENARIO("instrumentation counts compact blocks", "[instrumentation]")
+{
+    indirect_instrumentation_reset();
+
+    GIVEN("a `compact_indirect<base>` and a copy of it")
+    {
+        {
+            compact_indirect<base> b(derived(7));
+            auto c = b;
+            REQUIRE(c->get_value() == 7);
+        }
+
+        THEN("both blocks are allocated and released")
+        {
+            auto s = stats_for(typeid(derived), "compact");
+            REQUIRE(s.constructions == 1);
+            REQUIRE(s.copies == 1);
+            REQUIRE(s.destroys == 2);
+            REQUIRE(s.allocations == 2);
+            REQUIRE(s.deallocations == 2);
+            REQUIRE(s.allocated_bytes == s.deallocated_bytes);
+        }
+    }
+}
+
+SCENARIO("instrumentation counts live blocks and peak bytes", "[instrumentation]")
+{
+    indirect_instrumentation_reset();
+
+    GIVEN("three live `indirect<base>`s, one of which is then destroyed")
+    {
+        std::vector<indirect<base>> v;
+        v.emplace_back(derived(1));
+        v.emplace_back(derived(2));
+        v.emplace_back(derived(3));
+        auto peak = stats_for(typeid(derived), "direct");
+        v.pop_back();
+
+        THEN("the live count falls and the peak does not")
+        {
+            auto s = stats_for(typeid(derived), "direct");
+            REQUIRE(peak.live == 3);
+            REQUIRE(s.live == 2);
+            REQUIRE(s.peak_bytes == peak.peak_bytes);
+            REQUIRE(s.peak_bytes >= 3 * sizeof(derived));
+            REQUIRE(s.peak_bytes == peak.allocated_bytes);
+        }
+    }
+}
+
+SCENARIO("instrumentation bounds the peak bytes of blocks made on two threads", "[instrumentation][thread]")
+{
+    indirect_instrumentation_reset();
+
+    GIVEN("two threads, one after the other, that each make and destroy a block")
+    {
+        for (int t = 0; t < 2; ++t)
+        {
+            std::thread([] {
+                indirect<base> b(derived(1));
+                (void)b;
+            }).join();
+        }
+
+        THEN("the peak is the sum of the threads' peaks, though one block was live at a time")
+        {
+            auto s = stats_for(typeid(derived), "direct");
+            REQUIRE(s.allocations == 2);
+            REQUIRE(s.live == 0);
+            REQUIRE(s.peak_bytes == s.allocated_bytes);
+        }
+    }
+}
+
+SCENARIO("instrumentation traces blocks to the call site that made them", "[instrumentation][site]")
+{
+    indirect_instrumentation_reset();
+
+    GIVEN("an `indirect<base>` made at a call site, and copies of it")
+    {
+        auto const& site = INDIRECT_CALL_SITE;
+        {
+            auto b = make_indirect<derived>(site, 7);
+            indirect<base> c = b;
+            auto d = std::move(c);
+            indirect<base> e(derived(8));
+            e = d;
+            indirect<base> untraced(derived(9));
+            REQUIRE(e->get_value() == 7);
+
+            THEN("the copies count against the site while they live")
+            {
+                auto s = stats_for(site);
+                REQUIRE(s.constructions == 1);
+                REQUIRE(s.copies == 2);
+                REQUIRE(s.live == 2);
+                REQUIRE(std::strcmp(s.function, site.function) == 0);
+            }
+        }
+
+        THEN("their destruction counts against it")
+        {
+            auto s = stats_for(site);
+            REQUIRE(s.constructions == 1);
+            REQUIRE(s.destroys == 2);
+            REQUIRE(s.live == 0);
+        }
+    }
+
+    GIVEN("an `indirect` made with INDIRECT_CALL_SITE inline")
+    {
+        auto b = make_indirect<derived>(INDIRECT_CALL_SITE, 7);
+
+        THEN("its site names this file")
+        {
+            auto sites = indirect_instrumentation_sites();
+            auto found = false;
+            for (auto const& s : sites)
+            {
+                found = found || (s.constructions == 1 && std::strstr(s.file, "test_instrumentation") != nullptr);
+            }
+            REQUIRE(found);
+        }
+    }
+}
+
+SCENARIO("instrumentation dumps its counters", "[instrumentation][dump]")
+{
+    indirect_instrumentation_reset();
+
+    GIVEN("a live `indirect` made at a call site")
+    {
+        auto const& site = INDIRECT_CALL_SITE;
+        auto b = make_indirect<derived>(site, 7);
+
+        WHEN("the counters are dumped")
+        {
+            std::string out;
+            indirect_instrumentation_dump(
+                [](char const* data, std::size_t size, void* context) {
+                    static_cast<std::string*>(context)->append(data, size);
+                },
+                &out);
+
+            THEN("a line names the block type and the site")
+            {
+                REQUIRE(out.find(std::string("indirect direct ") + typeid(derived).name() + " live=1") !=
+                        std::string::npos);
+                REQUIRE(out.find("indirect site ") != std::string::npos);
+                REQUIRE(out.find(":" + std::to_string(site.line) + " ") != std::string::npos);
+                REQUIRE(out.back() == '\n');
+            }
+        }
+    }
+}
+
+SCENARIO("instrumentation counts blocks made on many threads", "[instrumentation][thread]")
+{
+    indirect_instrumentation_reset();
+
+    GIVEN("threads that copy `indirect`s concurrently")
+    {
+        constexpr int thread_count = 8;
+        constexpr int copy_count = 1000;
+        indirect<base> const b(derived(7));
+        std::vector<std::thread> threads;
+        for (int t = 0; t < thread_count; ++t)
+        {
+            threads.emplace_back([&b] {
+                for (int i = 0; i < copy_count; ++i)
+                {
+                    auto c = b;
+                    (void)c;
+                }
+            });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+
+        THEN("no count is lost")
+        {
+            auto s = stats_for(typeid(derived), "direct");
+            REQUIRE(s.copies == thread_count * copy_count);
+            REQUIRE(s.destroys == thread_count * copy_count);
+            REQUIRE(s.live == 1);
+        }
+    }
+}
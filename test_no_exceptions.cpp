@@ -0,0 +1,176 @@
+#include <catch.hpp>
+#include <compact_indirect.h>
+#include <cow_indirect.h>
+#include <indirect.h>
+#include <indirect_array.h>
+#include <indirect_parallel.h>
+#include <indirect_vector.h>
+#include <pooled_indirect.h>
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#ifdef INDIRECT_HAS_EXCEPTIONS
+#error "this test must be built without exceptions"
+#endif
+
+namespace
+{
+
+    // Makes the next nothrow allocations fail.
+    int failing_allocations = 0;
+
+} // namespace
+
+// Without exceptions `indirect` allocates with `new (std::nothrow)`, which is
+// replaced to fail on demand; the other forms are replaced to match it.
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept
+{
+    if (failing_allocations > 0)
+    {
+        --failing_allocations;
+        return nullptr;
+    }
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new(std::size_t size)
+{
+    if (auto p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    std::abort();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::nothrow_t const&) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+
+    class base
+    {
+    public:
+        virtual ~base() = default;
+        virtual int get_value() const = 0;
+    };
+
+    class derived : public base
+    {
+    private:
+        int value;
+
+    public:
+        static size_t object_count;
+
+        derived(int v) : value(v) { ++object_count; }
+        derived(derived const& other) : value(other.value) { ++object_count; }
+        ~derived() { --object_count; }
+        int get_value() const override { return value; }
+    };
+
+    size_t derived::object_count = 0u;
+
+    class derived_other : public base
+    {
+    public:
+        int get_value() const override { return 0; }
+    };
+
+} // namespace
+
+SCENARIO("without exceptions `try_` functions report failed allocations", "[try][noexcept]")
+{
+    GIVEN("an `indirect<base>` holding a `derived`")
+    {
+        indirect<base> b1 = try_make_indirect<derived>(42);
+
+        REQUIRE(b1);
+
+        WHEN("its copy cannot be allocated")
+        {
+            failing_allocations = 1;
+            auto b2 = try_copy(b1);
+
+            THEN("the copy is empty and the original untouched")
+            {
+                REQUIRE(!b2);
+                REQUIRE(derived::object_count == 1);
+                REQUIRE(b1->get_value() == 42);
+            }
+        }
+
+        WHEN("its copy can be allocated")
+        {
+            auto b2 = try_copy(b1);
+            auto d1 = try_dynamic_indirect_cast<derived>(b1);
+
+            THEN("the copies hold the value")
+            {
+                REQUIRE(b2->get_value() == 42);
+                REQUIRE(d1->get_value() == 42);
+            }
+        }
+
+        THEN("a dynamic cast to another type is empty")
+        {
+            REQUIRE(!try_dynamic_indirect_cast<derived_other>(b1));
+        }
+    }
+
+    GIVEN("an allocation that fails")
+    {
+        failing_allocations = 1;
+        auto b1 = try_make_indirect<derived>(42);
+
+        REQUIRE(!b1);
+        REQUIRE(derived::object_count == 0);
+    }
+
+    GIVEN("an `indirect<derived, exact_type>` whose copy cannot be allocated")
+    {
+        indirect<derived, exact_type> e1{in_place, 42};
+        failing_allocations = 1;
+
+        REQUIRE(!try_copy(e1));
+        REQUIRE(try_copy(e1)->get_value() == 42);
+    }
+
+    failing_allocations = 0;
+    REQUIRE(derived::object_count == 0);
+}
+
+SCENARIO("without exceptions the other handles still work", "[noexcept]")
+{
+    auto c = make_compact_indirect<derived>(1);
+    auto c2 = c;
+    cow_indirect<base> w = make_cow_indirect<derived>(2);
+    auto w2 = w;
+    pooled_indirect<base> p = derived{3};
+    auto p2 = p;
+    auto a = make_indirect_array<derived>(4, 4);
+    indirect_vector<base> v;
+    v.emplace<derived>(5);
+    auto v2 = v;
+    auto a2 = parallel_copy(a);
+
+    REQUIRE(c2->get_value() == 1);
+    REQUIRE(w2->get_value() == 2);
+    REQUIRE(p2->get_value() == 3);
+    REQUIRE(a2[3]->get_value() == 4);
+    REQUIRE(v2.size<derived>() == 1);
+}
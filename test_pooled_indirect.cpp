@@ -0,0 +1,272 @@
+#include <catch.hpp>
+#include <pooled_indirect.h>
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+    class base
+    {
+    public:
+        virtual ~base() = default;
+        virtual int get_value() const = 0;
+        virtual void set_value(int) = 0;
+    };
+
+    class derived : public base
+    {
+    private:
+        int value;
+
+    public:
+        static size_t object_count;
+
+    public:
+        derived() : value() { ++object_count; }
+        derived(derived const& other) noexcept : value(other.value) { ++object_count; }
+        derived(int v) : value(v) { ++object_count; }
+        ~derived() { --object_count; }
+        int get_value() const override { return value; }
+        void set_value(int i) override { value = i; }
+    };
+
+    size_t derived::object_count = 0u;
+
+    class derived_final final : public derived
+    {
+    public:
+        using derived::derived;
+    };
+
+#ifdef __cpp_aligned_new
+    struct alignas(64) over_aligned : base
+    {
+        int value = 0;
+        int get_value() const override { return value; }
+        void set_value(int i) override { value = i; }
+    };
+#endif
+
+    // The only type of its size class, so its pools start empty on each thread.
+    struct mid_sized : derived
+    {
+        using derived::derived;
+        char padding[300] = {};
+    };
+
+    constexpr int many = 3 * static_cast<int>(detail::pool_chunk_size / 32);
+
+    struct large : derived
+    {
+        using derived::derived;
+        char padding[2 * detail::pool_max_block_size] = {};
+    };
+
+} // namespace
+
+SCENARIO("`pooled_indirect` has value semantics", "[pooled][construct]")
+{
+    GIVEN("a `pooled_indirect<base>` holding a `derived`")
+    {
+        pooled_indirect<base> b1{derived{42}};
+
+        WHEN("it is copied")
+        {
+            pooled_indirect<base> b2{b1};
+            b2->set_value(7);
+
+            REQUIRE(derived::object_count == 2);
+            REQUIRE(b1->get_value() == 42);
+            REQUIRE(b2->get_value() == 7);
+        }
+
+        WHEN("it is moved and cast")
+        {
+            pooled_indirect<base> b2{std::move(b1)};
+            auto d1 = dynamic_indirect_cast<derived>(b2);
+
+            REQUIRE(!b1);
+            REQUIRE(derived::object_count == 2);
+            REQUIRE(d1->get_value() == 42);
+        }
+    }
+
+    GIVEN("a `pooled_indirect` of a final type")
+    {
+        pooled_indirect<derived_final> f1{in_place, 42};
+        pooled_indirect<derived_final> f2{f1};
+
+        REQUIRE(derived::object_count == 2);
+        REQUIRE(f2->get_value() == 42);
+    }
+
+    REQUIRE(derived::object_count == 0);
+}
+
+SCENARIO("`pooled_indirect` reuses freed control blocks", "[pooled][reuse]")
+{
+    GIVEN("the address of a destroyed `pooled_indirect`'s object")
+    {
+        void const* address;
+        {
+            pooled_indirect<base> b{derived{1}};
+            address = &*b;
+        }
+
+        THEN("the next block of the same size class takes its place")
+        {
+            pooled_indirect<base> b{derived{2}};
+
+            REQUIRE(static_cast<void const*>(&*b) == address);
+        }
+    }
+
+    GIVEN("more blocks than a chunk holds, destroyed in bulk")
+    {
+        std::vector<pooled_indirect<base>> v;
+        for (int i = 0; i < many; ++i)
+        {
+            v.emplace_back(derived{i});
+        }
+        v.clear();
+
+        THEN("they can all be taken again")
+        {
+            for (int i = 0; i < many; ++i)
+            {
+                v.emplace_back(derived{i});
+            }
+
+            REQUIRE(derived::object_count == v.size());
+            REQUIRE(v.back()->get_value() == many - 1);
+        }
+    }
+
+    REQUIRE(derived::object_count == 0);
+}
+
+SCENARIO("`pooled_indirect` objects are emplaced into their pooled block", "[pooled][emplace]")
+{
+    GIVEN("a `pooled_indirect<base>` holding a `derived`")
+    {
+        pooled_indirect<base> b{derived{1}};
+        auto p = static_cast<void const*>(&*b);
+
+        WHEN("an object of the same size class is emplaced")
+        {
+            b.emplace<derived_final>(2);
+
+            THEN("it takes the place of the old one")
+            {
+                REQUIRE(derived::object_count == 1);
+                REQUIRE(static_cast<void const*>(&*b) == p);
+                REQUIRE(b->get_value() == 2);
+            }
+        }
+
+        WHEN("an object of another size class is emplaced")
+        {
+            b.emplace<mid_sized>(3);
+
+            THEN("it is taken from its own pool")
+            {
+                REQUIRE(derived::object_count == 1);
+                REQUIRE(static_cast<void const*>(&*b) != p);
+                REQUIRE(b->get_value() == 3);
+            }
+        }
+    }
+
+    REQUIRE(derived::object_count == 0);
+}
+
+SCENARIO("`pooled_indirect` blocks can be freed by another thread", "[pooled][thread]")
+{
+    GIVEN("blocks created on one thread")
+    {
+        std::vector<pooled_indirect<base>> v;
+        std::thread([&] {
+            for (int i = 0; i < many; ++i)
+            {
+                v.emplace_back(derived{i});
+            }
+        }).join();
+
+        WHEN("they are copied and destroyed on another")
+        {
+            std::thread([&] {
+                auto copy = v;
+                v.clear();
+                REQUIRE(copy[1]->get_value() == 1);
+            }).join();
+
+            REQUIRE(derived::object_count == 0);
+        }
+    }
+
+    REQUIRE(derived::object_count == 0);
+}
+
+SCENARIO("`pooled_indirect` blocks freed remotely return to their owner", "[pooled][thread][remote]")
+{
+    GIVEN("a block created on a producer thread and destroyed on a consumer")
+    {
+        void const* first = nullptr;
+        void const* reused = nullptr;
+        std::thread([&] {
+            pooled_indirect<base> b{mid_sized{1}};
+            first = &*b;
+            std::thread([&] { auto m = std::move(b); }).join();
+
+            pooled_indirect<base> c{mid_sized{2}};
+            reused = &*c;
+        }).join();
+
+        THEN("the producer reuses it for its next block")
+        {
+            REQUIRE(first == reused);
+        }
+    }
+
+    REQUIRE(derived::object_count == 0);
+}
+
+SCENARIO("`pooled_indirect` falls back to the free store", "[pooled][fallback]")
+{
+#ifdef __cpp_aligned_new
+    GIVEN("an over-aligned type")
+    {
+        pooled_indirect<base> b1{over_aligned{}};
+        b1->set_value(42);
+        pooled_indirect<base> b2{b1};
+
+        REQUIRE(reinterpret_cast<std::uintptr_t>(&*b2) % 64 == 0);
+        REQUIRE(b2->get_value() == 42);
+    }
+#endif
+
+    GIVEN("a type larger than the largest size class")
+    {
+        pooled_indirect<base> b1{large{42}};
+        pooled_indirect<base> b2{b1};
+
+        REQUIRE(derived::object_count == 2);
+        REQUIRE(b2->get_value() == 42);
+    }
+
+    GIVEN("inline storage")
+    {
+        pooled_indirect<base, inline_storage<4 * sizeof(void*)>> b1{derived{42}};
+        auto b2 = b1;
+        auto b3 = std::move(b1);
+
+        REQUIRE(static_cast<void const*>(&*b2) > static_cast<void const*>(&b2));
+        REQUIRE(static_cast<void const*>(&*b2) < static_cast<void const*>(&b2 + 1));
+        REQUIRE(b3->get_value() == 42);
+    }
+
+    REQUIRE(derived::object_count == 0);
+}